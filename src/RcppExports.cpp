@@ -25,8 +25,135 @@ BEGIN_RCPP
 END_RCPP
 }
 
+// write_data
+void write_data(const arma::mat& X, const arma::mat& Y, std::string file, bool row_major, bool single);
+RcppExport SEXP _sgd_write_data(SEXP XSEXP, SEXP YSEXP, SEXP fileSEXP, SEXP row_majorSEXP, SEXP singleSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const arma::mat& >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< std::string >::type file(fileSEXP);
+    Rcpp::traits::input_parameter< bool >::type row_major(row_majorSEXP);
+    Rcpp::traits::input_parameter< bool >::type single(singleSEXP);
+    write_data(X, Y, file, row_major, single);
+    return R_NilValue;
+END_RCPP
+}
+// alloc_count
+double alloc_count();
+RcppExport SEXP _sgd_alloc_count() {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    rcpp_result_gen = Rcpp::wrap(alloc_count());
+    return rcpp_result_gen;
+END_RCPP
+}
+// read_data_header
+Rcpp::List read_data_header(std::string file);
+RcppExport SEXP _sgd_read_data_header(SEXP fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type file(fileSEXP);
+    rcpp_result_gen = Rcpp::wrap(read_data_header(file));
+    return rcpp_result_gen;
+END_RCPP
+}
+// checkpoint_info
+Rcpp::List checkpoint_info(std::string file);
+RcppExport SEXP _sgd_checkpoint_info(SEXP fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type file(fileSEXP);
+    rcpp_result_gen = Rcpp::wrap(checkpoint_info(file));
+    return rcpp_result_gen;
+END_RCPP
+}
+// online_new
+SEXP online_new(SEXP model_control, SEXP sgd_control);
+RcppExport SEXP _sgd_online_new(SEXP model_controlSEXP, SEXP sgd_controlSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type model_control(model_controlSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type sgd_control(sgd_controlSEXP);
+    rcpp_result_gen = Rcpp::wrap(online_new(model_control, sgd_control));
+    return rcpp_result_gen;
+END_RCPP
+}
+// online_partial_fit
+Rcpp::List online_partial_fit(SEXP online, SEXP dataset, SEXP sgd_control);
+RcppExport SEXP _sgd_online_partial_fit(SEXP onlineSEXP, SEXP datasetSEXP, SEXP sgd_controlSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type online(onlineSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type dataset(datasetSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type sgd_control(sgd_controlSEXP);
+    rcpp_result_gen = Rcpp::wrap(online_partial_fit(online, dataset, sgd_control));
+    return rcpp_result_gen;
+END_RCPP
+}
+// run_async
+SEXP run_async(SEXP dataset, SEXP model_control, SEXP sgd_control);
+RcppExport SEXP _sgd_run_async(SEXP datasetSEXP, SEXP model_controlSEXP, SEXP sgd_controlSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type dataset(datasetSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type model_control(model_controlSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type sgd_control(sgd_controlSEXP);
+    rcpp_result_gen = Rcpp::wrap(run_async(dataset, model_control, sgd_control));
+    return rcpp_result_gen;
+END_RCPP
+}
+// async_poll
+Rcpp::List async_poll(SEXP handle);
+RcppExport SEXP _sgd_async_poll(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(async_poll(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// async_cancel
+void async_cancel(SEXP handle);
+RcppExport SEXP _sgd_async_cancel(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    async_cancel(handle);
+    return R_NilValue;
+END_RCPP
+}
+// async_result
+Rcpp::List async_result(SEXP handle);
+RcppExport SEXP _sgd_async_result(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(async_result(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+
 static const R_CallMethodDef CallEntries[] = {
     {"_sgd_run", (DL_FUNC) &_sgd_run, 3},
+    {"_sgd_write_data", (DL_FUNC) &_sgd_write_data, 5},
+    {"_sgd_alloc_count", (DL_FUNC) &_sgd_alloc_count, 0},
+    {"_sgd_read_data_header", (DL_FUNC) &_sgd_read_data_header, 1},
+    {"_sgd_checkpoint_info", (DL_FUNC) &_sgd_checkpoint_info, 1},
+    {"_sgd_online_new", (DL_FUNC) &_sgd_online_new, 2},
+    {"_sgd_online_partial_fit", (DL_FUNC) &_sgd_online_partial_fit, 3},
+    {"_sgd_run_async", (DL_FUNC) &_sgd_run_async, 3},
+    {"_sgd_async_poll", (DL_FUNC) &_sgd_async_poll, 1},
+    {"_sgd_async_cancel", (DL_FUNC) &_sgd_async_cancel, 1},
+    {"_sgd_async_result", (DL_FUNC) &_sgd_async_result, 1},
     {NULL, NULL, 0}
 };
 
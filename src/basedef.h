@@ -3,6 +3,30 @@
 
 #define BOOST_DISABLE_ASSERTS true
 
+#include <atomic>
+#include <cstdlib>
+
+// Heap allocations made by Armadillo are counted in test builds only, so that
+// tests can check that iterations of the update loop make none. The hook must
+// be seen by every translation unit that includes Armadillo, RcppExports.cpp
+// among them, so such a build defines SGD_COUNT_ALLOCS and forces this header
+// first, e.g., with
+//   PKG_CPPFLAGS = -DSGD_COUNT_ALLOCS -include basedef.h
+#ifdef SGD_COUNT_ALLOCS
+inline std::atomic<unsigned long>& arma_alloc_count() {
+  static std::atomic<unsigned long> count(0);
+  return count;
+}
+
+inline void* arma_counted_malloc(size_t n_bytes) {
+  arma_alloc_count().fetch_add(1, std::memory_order_relaxed);
+  return std::malloc(n_bytes);
+}
+
+#define ARMA_ALIEN_MEM_ALLOC_FUNCTION arma_counted_malloc
+#define ARMA_ALIEN_MEM_FREE_FUNCTION std::free
+#endif
+
 #include "RcppArmadillo.h"
 #include <bigmemory/MatrixAccessor.hpp>
 #include <boost/function.hpp>
@@ -13,7 +37,14 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <random>
+#include <thread>
 
 using namespace arma;
 
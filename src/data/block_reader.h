@@ -0,0 +1,148 @@
+#ifndef DATA_BLOCK_READER_H
+#define DATA_BLOCK_READER_H
+
+#include "../basedef.h"
+
+template<typename T>
+class block_reader {
+  /**
+   * Prefetching reader of blocks of rows from column-major storage, such as a
+   * file-backed bigmatrix. Rows are gathered into row-major buffers, one of
+   * which is consumed while the next block is read on a background thread.
+   * The response may be gathered along with the covariates, so that it is not
+   * held in memory either.
+   *
+   * A row returned by get_row() stays valid while its block or the block
+   * after it is being consumed: the block before the current one is kept
+   * apart from the one being prefetched, so rows taken just before a block
+   * boundary, e.g., by a batch that spans it, are not overwritten. A reader
+   * serves one thread only, as get_row() changes its state and starts the
+   * prefetch.
+   *
+   * @tparam T         type of the elements of the matrix
+   * @param cols       first element of each column of covariates
+   * @param ycol       first element of the column of responses, or NULL if
+   *                   they are not read from the matrix
+   * @param n_iters    total number of iterations to be served
+   * @param block_size number of rows per block
+   * @param idxmap     map from (zero-based) iteration to row index; it is
+   *                   called on the prefetching thread, so must not refer to
+   *                   state that changes
+   */
+public:
+  block_reader(const std::vector<const T*>& cols, const T* ycol,
+    unsigned n_iters, unsigned block_size,
+    std::function<unsigned(unsigned)> idxmap) :
+    cols_(cols), ycol_(ycol), n_features_(cols.size()), n_iters_(n_iters),
+    block_size_(block_size), idxmap_(idxmap), cur_(0), next_(1) {
+    for (unsigned b = 0; b < n_blocks; ++b) {
+      blocks_[b].x = std::vector<T>(
+        static_cast<size_t>(block_size_) * n_features_);
+      blocks_[b].y = std::vector<double>(ycol_ ? block_size_ : 0);
+      blocks_[b].idx = std::vector<unsigned>(block_size_);
+      blocks_[b].start = n_iters_;
+      blocks_[b].len = 0;
+    }
+  }
+
+  ~block_reader() {
+    wait_();
+  }
+
+  // Covariates of the row read at iteration t, contiguous in memory; its row
+  // index is written to idx, and its response to y if read from the matrix.
+  const T* get_row(unsigned t, unsigned& idx, double& y) {
+    if (!in_block_(cur_, t)) {
+      wait_();
+      unsigned prev = cur_;
+      if (in_block_(next_, t)) {
+        cur_ = next_;
+      } else {
+        // Not the block we prefetched, e.g., the first one: read it now.
+        cur_ = spare_(prev, next_);
+        set_block_(cur_, t - t % block_size_);
+        fill_(cur_);
+      }
+      unsigned start = blocks_[cur_].start + block_size_;
+      if (start < n_iters_) {
+        next_ = spare_(prev, cur_);
+        set_block_(next_, start);
+        worker_ = std::thread(&block_reader::fill_, this, next_);
+      }
+    }
+    const block& b = blocks_[cur_];
+    unsigned r = t - b.start;
+    idx = b.idx[r];
+    if (ycol_) {
+      y = b.y[r];
+    }
+    return b.x.data() + static_cast<size_t>(r) * n_features_;
+  }
+
+private:
+  struct block {
+    std::vector<T> x;           // row-major covariates
+    std::vector<double> y;      // responses, if read from the matrix
+    std::vector<unsigned> idx;  // row index of each buffered row
+    unsigned start;             // first iteration held
+    unsigned len;               // number of iterations held
+  };
+
+  static const unsigned n_blocks = 3; // current, previous and prefetched
+
+  // A buffer other than a and b
+  static unsigned spare_(unsigned a, unsigned b) {
+    unsigned k = 0;
+    while (k == a || k == b) {
+      ++k;
+    }
+    return k;
+  }
+
+  bool in_block_(unsigned b, unsigned t) const {
+    return t >= blocks_[b].start && t < blocks_[b].start + blocks_[b].len;
+  }
+
+  void set_block_(unsigned b, unsigned start) {
+    blocks_[b].start = start;
+    blocks_[b].len = std::min(block_size_, n_iters_ - start);
+  }
+
+  // Gather the rows of a block, reading the matrix column by column.
+  void fill_(unsigned b) {
+    block& blk = blocks_[b];
+    for (unsigned r = 0; r < blk.len; ++r) {
+      blk.idx[r] = idxmap_(blk.start + r);
+    }
+    for (unsigned i = 0; i < n_features_; ++i) {
+      const T* col = cols_[i];
+      for (unsigned r = 0; r < blk.len; ++r) {
+        blk.x[static_cast<size_t>(r) * n_features_ + i] = col[blk.idx[r]];
+      }
+    }
+    if (ycol_) {
+      for (unsigned r = 0; r < blk.len; ++r) {
+        blk.y[r] = ycol_[blk.idx[r]];
+      }
+    }
+  }
+
+  void wait_() {
+    if (worker_.joinable()) {
+      worker_.join();
+    }
+  }
+
+  std::vector<const T*> cols_;
+  const T* ycol_;
+  unsigned n_features_;
+  unsigned n_iters_;
+  unsigned block_size_;
+  std::function<unsigned(unsigned)> idxmap_;
+  block blocks_[n_blocks];
+  unsigned cur_;        // block being consumed
+  unsigned next_;       // block being prefetched
+  std::thread worker_;
+};
+
+#endif
@@ -0,0 +1,241 @@
+#ifndef DATA_DATA_FILE_H
+#define DATA_DATA_FILE_H
+
+#include "../basedef.h"
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Header at the start of a data file. All offsets are in bytes from the start
+// of the file and are multiples of 64, as is the distance between rows.
+struct data_file_header {
+  char magic[8];        // "SGDDATA" followed by a zero byte
+  uint32_t version;     // format version, currently 1
+  uint32_t dtype;       // type of the values of X: 0 for double, 1 for float
+  uint32_t layout;      // 0 if X is stored column by column, 1 if row by row
+  uint32_t reserved;
+  uint64_t n_samples;   // number of rows of X and Y
+  uint64_t n_features;  // number of columns of X
+  uint64_t pitch;       // distance in values between rows if row by row
+  uint64_t x_offset;    // first value of X
+  uint64_t y_offset;    // first value of Y
+};
+
+static const char DATA_FILE_MAGIC[8] = {'S', 'G', 'D', 'D', 'A', 'T', 'A', 0};
+static const uint32_t DATA_FILE_VERSION = 1;
+static const uint64_t DATA_FILE_ALIGN = 64;
+
+class data_file {
+  /**
+   * Data file mapped read-only into memory. The design matrix and responses
+   * are used in place, so opening a file takes the same time regardless of
+   * its size, and fits on the same file share the operating system's page
+   * cache.
+   *
+   * @param file path of the file, as written by write_data_file()
+   */
+public:
+  data_file(std::string file) : file_(file), base_(NULL), size_(0) {
+    map_();
+    if (size_ < sizeof(data_file_header)) {
+      unmap_();
+      Rcpp::stop("'" + file_ + "' is not an sgd data file");
+    }
+    memcpy(&header_, base_, sizeof(data_file_header));
+    if (!valid_()) {
+      unmap_();
+      Rcpp::stop("'" + file_ + "' is not an sgd data file");
+    }
+  }
+
+  ~data_file() {
+    unmap_();
+  }
+
+  const data_file_header& header() const {
+    return header_;
+  }
+
+  // X if stored in double precision
+  const double* x() const {
+    return header_.dtype ? NULL :
+      reinterpret_cast<const double*>(base_ + header_.x_offset);
+  }
+
+  // X if stored in single precision
+  const float* xf() const {
+    return header_.dtype ?
+      reinterpret_cast<const float*>(base_ + header_.x_offset) : NULL;
+  }
+
+  const double* y() const {
+    return reinterpret_cast<const double*>(base_ + header_.y_offset);
+  }
+
+private:
+  // Whether the header describes values that lie within the file, each
+  // aligned to its type, in dimensions that a data set can index
+  bool valid_() const {
+    const data_file_header& h = header_;
+    if (memcmp(h.magic, DATA_FILE_MAGIC, 8) != 0 ||
+        h.version != DATA_FILE_VERSION || h.dtype > 1 || h.layout > 1) {
+      return false;
+    }
+    uint64_t max_index = std::numeric_limits<unsigned>::max();
+    if (h.n_samples > max_index || h.n_features > max_index ||
+        (h.layout && h.pitch < h.n_features)) {
+      return false;
+    }
+    uint64_t x_size = h.dtype ? sizeof(float) : sizeof(double);
+    if (h.x_offset % x_size != 0 || h.y_offset % sizeof(double) != 0) {
+      return false;
+    }
+    uint64_t row_size = h.layout ? h.pitch : h.n_features;
+    if (row_size != 0 &&
+        h.n_samples > std::numeric_limits<uint64_t>::max() / row_size) {
+      return false;
+    }
+    return fits_(h.x_offset, h.n_samples * row_size, x_size) &&
+      fits_(h.y_offset, h.n_samples, sizeof(double));
+  }
+
+  // Whether n values of the given size from offset lie within the file,
+  // computed without overflow
+  bool fits_(uint64_t offset, uint64_t n, uint64_t elem_size) const {
+    return offset <= size_ && n <= (size_ - offset) / elem_size;
+  }
+
+#ifdef _WIN32
+  void map_() {
+    HANDLE fh = CreateFileA(file_.c_str(), GENERIC_READ, FILE_SHARE_READ,
+      NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fh == INVALID_HANDLE_VALUE) {
+      Rcpp::stop("cannot open data file '" + file_ + "'");
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(fh, &size);
+    size_ = static_cast<size_t>(size.QuadPart);
+    HANDLE mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(fh);
+    if (mh == NULL) {
+      Rcpp::stop("cannot map data file '" + file_ + "'");
+    }
+    base_ = static_cast<const char*>(
+      MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0));
+    CloseHandle(mh);
+    if (base_ == NULL) {
+      Rcpp::stop("cannot map data file '" + file_ + "'");
+    }
+  }
+
+  void unmap_() {
+    if (base_ != NULL) {
+      UnmapViewOfFile(base_);
+      base_ = NULL;
+    }
+  }
+#else
+  void map_() {
+    int fd = open(file_.c_str(), O_RDONLY);
+    if (fd < 0) {
+      Rcpp::stop("cannot open data file '" + file_ + "'");
+    }
+    struct stat st;
+    fstat(fd, &st);
+    size_ = static_cast<size_t>(st.st_size);
+    void* addr = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      Rcpp::stop("cannot map data file '" + file_ + "'");
+    }
+    base_ = static_cast<const char*>(addr);
+  }
+
+  void unmap_() {
+    if (base_ != NULL) {
+      munmap(const_cast<char*>(base_), size_);
+      base_ = NULL;
+    }
+  }
+#endif
+
+  std::string file_;
+  const char* base_;          // start of the mapping
+  size_t size_;               // length of the mapping
+  data_file_header header_;
+};
+
+/**
+ * Writes a design matrix and responses to a data file.
+ *
+ * @param X         design matrix
+ * @param Y         response values
+ * @param file      path of the file to write
+ * @param row_major whether to store X row by row, each row padded to a whole
+ *                  number of 64-byte cache lines
+ * @tparam T        type in which X is stored; Y is always stored as double
+ */
+template<typename T>
+inline void write_data_file(const mat& X, const mat& Y, std::string file,
+  bool row_major) {
+  const uint64_t line = DATA_FILE_ALIGN / sizeof(T);
+  data_file_header header;
+  memset(&header, 0, sizeof(data_file_header));
+  memcpy(header.magic, DATA_FILE_MAGIC, 8);
+  header.version = DATA_FILE_VERSION;
+  header.dtype = sizeof(T) == sizeof(float) ? 1 : 0;
+  header.layout = row_major ? 1 : 0;
+  header.n_samples = X.n_rows;
+  header.n_features = X.n_cols;
+  header.pitch = row_major ? ((X.n_cols + line - 1) / line) * line : 0;
+  header.x_offset = DATA_FILE_ALIGN;
+  uint64_t x_values = row_major ? header.n_samples * header.pitch :
+    header.n_samples * header.n_features;
+  header.y_offset = ((header.x_offset + x_values * sizeof(T) +
+    DATA_FILE_ALIGN - 1) / DATA_FILE_ALIGN) * DATA_FILE_ALIGN;
+
+  FILE* fp = fopen(file.c_str(), "wb");
+  if (fp == NULL) {
+    Rcpp::stop("cannot open '" + file + "' for writing");
+  }
+  std::vector<char> pad(DATA_FILE_ALIGN, 0);
+  bool ok = fwrite(&header, sizeof(data_file_header), 1, fp) == 1;
+  ok = ok && fwrite(pad.data(), 1, header.x_offset - sizeof(data_file_header),
+    fp) == header.x_offset - sizeof(data_file_header);
+  if (row_major) {
+    std::vector<T> row(header.pitch, 0);
+    for (unsigned i = 0; ok && i < X.n_rows; ++i) {
+      for (unsigned j = 0; j < X.n_cols; ++j) {
+        row[j] = static_cast<T>(X(i, j));
+      }
+      ok = fwrite(row.data(), sizeof(T), row.size(), fp) == row.size();
+    }
+  } else {
+    std::vector<T> col(X.n_rows);
+    for (unsigned j = 0; ok && j < X.n_cols; ++j) {
+      const double* xj = X.colptr(j);
+      for (unsigned i = 0; i < X.n_rows; ++i) {
+        col[i] = static_cast<T>(xj[i]);
+      }
+      ok = fwrite(col.data(), sizeof(T), col.size(), fp) == col.size();
+    }
+  }
+  uint64_t y_pad = header.y_offset - header.x_offset -
+    x_values * sizeof(T);
+  ok = ok && fwrite(pad.data(), 1, y_pad, fp) == y_pad;
+  ok = ok && fwrite(Y.memptr(), sizeof(double), X.n_rows, fp) == X.n_rows;
+  if (fclose(fp) != 0 || !ok) {
+    Rcpp::stop("cannot write '" + file + "'");
+  }
+}
+
+#endif
@@ -7,15 +7,198 @@ struct data_point {
   /**
    * Collection of an individual observation's covariates and response.
    *
-   * @param x   covariates for a single sample
-   * @param y   response value for a single sample
-   * @param idx index of that data point into the data set
+   * The covariates are not copied: the data point is a view into the storage
+   * of the data set it was taken from, and is only valid as long as that
+   * storage is. Dense rows are described by a pointer and a stride; sparse
+   * rows by their nonzero values and the column index of each. Covariates
+   * stored in single precision are read as such and accumulated in double
+   * precision.
+   *
+   * @param x          pointer to the first covariate (or nonzero) of the sample
+   * @param stride     distance in memory between consecutive covariates
+   * @param ind        column indices of the nonzeros, or NULL if dense
+   * @param n_nonzero  number of nonzeros if sparse
+   * @param n_features number of covariates
+   * @param y          response value for a single sample
+   * @param idx        index of that data point into the data set
    */
-  data_point(const mat& x, double y, unsigned idx) : x(x), y(y), idx(idx) {}
+  data_point(const double* x, unsigned stride, unsigned n_features, double y,
+    unsigned idx) :
+    x(x), xf(NULL), stride(stride), ind(NULL), n_nonzero(n_features),
+    n_features(n_features), y(y), idx(idx) {}
+
+  data_point(const float* xf, unsigned stride, unsigned n_features, double y,
+    unsigned idx) :
+    x(NULL), xf(xf), stride(stride), ind(NULL), n_nonzero(n_features),
+    n_features(n_features), y(y), idx(idx) {}
+
+  data_point(const double* x, const uword* ind, unsigned n_nonzero,
+    unsigned n_features, double y, unsigned idx) :
+    x(x), xf(NULL), stride(1), ind(ind), n_nonzero(n_nonzero),
+    n_features(n_features), y(y), idx(idx) {}
+
+  // i-th covariate
+  double at(unsigned i) const {
+    if (xf) {
+      return xf[i * stride];
+    }
+    if (!ind) {
+      return x[i * stride];
+    }
+    const uword* pos = std::lower_bound(ind, ind + n_nonzero, i);
+    if (pos != ind + n_nonzero && *pos == i) {
+      return x[pos - ind];
+    }
+    return 0.;
+  }
+
+  // x^T theta
+  double dot(const mat& theta) const {
+    return xf ? dot_(xf, theta) : dot_(x, theta);
+  }
+
+  // x^T sign(theta)
+  double dot_sign(const mat& theta) const {
+    return xf ? dot_sign_(xf, theta) : dot_sign_(x, theta);
+  }
+
+  // ||x||^2
+  double sq_norm() const {
+    return xf ? sq_norm_(xf) : sq_norm_(x);
+  }
+
+  // x^T diag(w) x
+  double sq_norm(const vec& w) const {
+    return xf ? sq_norm_(xf, w) : sq_norm_(x, w);
+  }
+
+  // out += a * x^T, for a column vector out
+  void add_to(mat& out, double a) const {
+    if (xf) {
+      add_to_(xf, out, a);
+    } else {
+      add_to_(x, out, a);
+    }
+  }
 
-  mat x;
+  // out += a * diag(w) x^T, for a column vector out
+  void add_to(mat& out, double a, const vec& w) const {
+    if (xf) {
+      add_to_(xf, out, a, w);
+    } else {
+      add_to_(x, out, a, w);
+    }
+  }
+
+  // Covariates written densely to the n_features elements from out
+  void copy_to(double* out) const {
+    if (ind) {
+      std::fill(out, out + n_features, 0.);
+      for (unsigned k = 0; k < n_nonzero; ++k) {
+        out[ind[k]] = x[k];
+      }
+    } else if (xf) {
+      for (unsigned i = 0; i < n_features; ++i) {
+        out[i] = xf[i * stride];
+      }
+    } else {
+      for (unsigned i = 0; i < n_features; ++i) {
+        out[i] = x[i * stride];
+      }
+    }
+  }
+
+  // Covariates copied into a 1 x n_features matrix
+  mat to_mat() const {
+    mat out = zeros<mat>(1, n_features);
+    for (unsigned k = 0; k < n_nonzero; ++k) {
+      out.at(0, ind ? ind[k] : k) = xf ? xf[k * stride] : x[k * stride];
+    }
+    return out;
+  }
+
+  const double* x;
+  const float* xf;     // covariates if stored in single precision, else NULL
+  unsigned stride;
+  const uword* ind;
+  unsigned n_nonzero;
+  unsigned n_features;
   double y;
   unsigned idx;
+
+private:
+  template<typename T>
+  double dot_(const T* v, const mat& theta) const {
+    const double* th = theta.memptr();
+    double out = 0;
+    if (ind) {
+      for (unsigned k = 0; k < n_nonzero; ++k) {
+        out += v[k] * th[ind[k]];
+      }
+    } else {
+      for (unsigned i = 0; i < n_features; ++i) {
+        out += v[i * stride] * th[i];
+      }
+    }
+    return out;
+  }
+
+  template<typename T>
+  double dot_sign_(const T* v, const mat& theta) const {
+    const double* th = theta.memptr();
+    double out = 0;
+    for (unsigned k = 0; k < n_nonzero; ++k) {
+      unsigned i = ind ? ind[k] : k;
+      double vi = ind ? v[k] : v[k * stride];
+      out += (th[i] > 0) ? vi : ((th[i] < 0) ? -vi : 0.);
+    }
+    return out;
+  }
+
+  template<typename T>
+  double sq_norm_(const T* v) const {
+    double out = 0;
+    for (unsigned k = 0; k < n_nonzero; ++k) {
+      double vk = v[k * stride];
+      out += vk * vk;
+    }
+    return out;
+  }
+
+  template<typename T>
+  double sq_norm_(const T* v, const vec& w) const {
+    const double* wi = w.memptr();
+    double out = 0;
+    for (unsigned k = 0; k < n_nonzero; ++k) {
+      double vk = v[k * stride];
+      out += wi[ind ? ind[k] : k] * vk * vk;
+    }
+    return out;
+  }
+
+  template<typename T>
+  void add_to_(const T* v, mat& out, double a) const {
+    double* o = out.memptr();
+    if (ind) {
+      for (unsigned k = 0; k < n_nonzero; ++k) {
+        o[ind[k]] += a * v[k];
+      }
+    } else {
+      for (unsigned i = 0; i < n_features; ++i) {
+        o[i] += a * v[i * stride];
+      }
+    }
+  }
+
+  template<typename T>
+  void add_to_(const T* v, mat& out, double a, const vec& w) const {
+    double* o = out.memptr();
+    const double* wi = w.memptr();
+    for (unsigned k = 0; k < n_nonzero; ++k) {
+      unsigned i = ind ? ind[k] : k;
+      o[i] += a * wi[i] * v[k * stride];
+    }
+  }
 };
 
 #endif
@@ -2,88 +2,458 @@
 #define DATA_DATA_SET_H
 
 #include "../basedef.h"
+#include "block_reader.h"
+#include "data_file.h"
 #include "data_point.h"
-
-// wrapper around R's RNG such that we get a uniform distribution over
-// [0,n) as required by the STL algorithm
-inline int randWrapper(const int n) { return floor(unif_rand()*n); }
+#include "permutation.h"
+#include "stream_reader.h"
 
 class data_set {
   /**
    * Collection of all data points.
    *
-   * @param xpMat    pointer to bigmat if using bigmatrix
-   * @param Xx       design matrix if not using bigmatrix
-   * @param Yy       response values
-   * @param n_passes number of passes for data
-   * @param big      whether using bigmatrix or not
-   * @param shuffle  whether to shuffle data set or not
+   * @param xpMat     pointer to bigmat if using bigmatrix
+   * @param xpY       pointer to a bigmatrix whose first column holds the
+   *                  responses, or to NULL
+   * @param y_col     (one-based) column of bigmat holding the responses, or
+   *                  0; responses read from a bigmatrix are not held in memory
+   *                  and Y is empty
+   * @param Xx        design matrix if not using bigmatrix; it is viewed in
+   *                  place rather than copied, so must outlive the data set
+   * @param Xs        design matrix if sparse
+   * @param Yy        response values, unless read from a bigmatrix
+   * @param n_passes  number of passes for data
+   * @param big       whether using bigmatrix or not
+   * @param sparse    whether using a sparse design matrix or not
+   * @param shuffle   "none", "random" to visit the data points in a random
+   *                  order, or "block" to shuffle blocks of rows, and rows
+   *                  within windows of blocks
+   * @param seed      seed of the order in which data points are visited if
+   *                  shuffling
+   * @param shuffle_control block size and window for block shuffling
+   * @param row_major whether to pack the design matrix row by row so that
+   *                  each sample is contiguous in memory
+   * @param single    whether to store a dense, in-memory design matrix in
+   *                  single precision; a bigmatrix is used in the precision
+   *                  of its type
    */
 public:
-  data_set(const SEXP& xpMat, const mat& Xx, const mat& Yy, unsigned n_passes,
-    bool big, bool shuffle) : Y(Yy), big(big), xpMat_(xpMat), shuffle_(shuffle) {
-    if (!big) {
-      X = Xx;
+  data_set(const SEXP& xpMat, const SEXP& xpY, unsigned y_col, const mat& Xx,
+    const sp_mat& Xs, const mat& Yy, unsigned n_passes, bool big,
+    bool sparse, std::string shuffle, unsigned seed,
+    const vec& shuffle_control, bool row_major, bool single) :
+    X(const_cast<double*>(Xx.memptr()), Xx.n_rows, Xx.n_cols, false, true),
+    Y(Yy), big(big), sparse(sparse), stream(false), n_passes_(n_passes),
+    shared_(NULL), subset_(NULL), subset_first_(0), first_(0), big_y_(false),
+    rows_(NULL), rowsf_(NULL), pitch_(0), stride_(1), chunk_start_(0),
+    pass_start_(0), pass_(1), shuffle_(shuffle != "none"),
+    block_shuffle_(shuffle == "block"), perm_(0, seed),
+    block_perm_(0, seed, 1, 1) {
+    if (sparse) {
+      // Store the transpose, whose compressed columns are the rows of X.
+      n_samples = Xs.n_rows;
+      n_features = Xs.n_cols;
+      sprows_ = Xs.t();
+      sprows_.sync();
+    } else if (!big) {
       n_samples = X.n_rows;
       n_features = X.n_cols;
+      if (single) {
+        pack_single_(row_major);
+      } else if (row_major) {
+        pack_rows_();
+      }
     } else {
-      n_samples = xpMat_->nrow();
-      n_features = xpMat_->ncol();
-    }
-    if (shuffle_) {
-      idxvec_ = std::vector<unsigned>(n_samples*n_passes);
-      for (unsigned i = 0; i < n_passes; ++i) {
-        for (unsigned j = 0; j < n_samples; ++j) {
-          idxvec_[i * n_samples + j] = j;
+      Rcpp::XPtr<BigMatrix> bigmat(xpMat);
+      Rcpp::XPtr<BigMatrix> ymat(xpY);
+      n_samples = bigmat->nrow();
+      n_features = bigmat->ncol() - (y_col ? 1 : 0);
+      if (ymat.get() != NULL && (ymat->nrow() != bigmat->nrow() ||
+          ymat->matrix_type() != bigmat->matrix_type())) {
+        Rcpp::stop("big.matrix of responses must match the design matrix");
+      }
+      big_y_ = ymat.get() != NULL || y_col != 0;
+    }
+    set_order_(seed, shuffle_control);
+    if (big) {
+      // Rows are read a block at a time, with the next block prefetched while
+      // the current one is in use. The reader takes the order of the data
+      // points as set above.
+      Rcpp::XPtr<BigMatrix> bigmat(xpMat);
+      Rcpp::XPtr<BigMatrix> ymat(xpY);
+      if (bigmat->matrix_type() == big_double_) {
+        reader_ = make_reader_<double>(bigmat, ymat, y_col);
+      } else if (bigmat->matrix_type() == big_float_) {
+        readerf_ = make_reader_<float>(bigmat, ymat, y_col);
+      } else {
+        Rcpp::stop("big.matrix must be of type \"double\" or \"float\"");
+      }
+    }
+  }
+
+  /**
+   * Data points of a data file, used in place: X is only set if the file
+   * stores it column by column in double precision, and Y always views the
+   * file.
+   *
+   * @param file     mapped data file, owned by the data set
+   * @param n_passes number of passes for data
+   * @param shuffle  "none", "random" or "block", as above
+   * @param seed     seed of the order in which data points are visited if
+   *                 shuffling
+   * @param shuffle_control block size and window for block shuffling
+   */
+  data_set(data_file* file, unsigned n_passes, std::string shuffle,
+    unsigned seed, const vec& shuffle_control) :
+    X(const_cast<double*>(file->x()),
+      file->header().layout || !file->x() ? 0 : file->header().n_samples,
+      file->header().layout || !file->x() ? 0 : file->header().n_features,
+      false, true),
+    Y(const_cast<double*>(file->y()), file->header().n_samples, 1, false,
+      true),
+    big(false), sparse(false), stream(false),
+    n_samples(file->header().n_samples),
+    n_features(file->header().n_features), n_passes_(n_passes),
+    shared_(NULL), subset_(NULL), subset_first_(0), first_(0), big_y_(false),
+    rows_(NULL), rowsf_(NULL), pitch_(0), stride_(1), file_(file),
+    chunk_start_(0), pass_start_(0), pass_(1), shuffle_(shuffle != "none"),
+    block_shuffle_(shuffle == "block"), perm_(0, seed),
+    block_perm_(0, seed, 1, 1) {
+    if (file->xf()) {
+      rowsf_ = file->xf();
+      if (file->header().layout) {
+        pitch_ = file->header().pitch;
+      } else {
+        pitch_ = 1;
+        stride_ = n_samples;
+      }
+    } else if (file->header().layout) {
+      rows_ = file->x();
+      pitch_ = file->header().pitch;
+    }
+    set_order_(seed, shuffle_control);
+  }
+
+  /**
+   * Data points read in order from a stream, whose number is not known in
+   * advance; n_samples is 0.
+   *
+   * @param stream   reader of the stream, owned by the data set
+   * @param n_passes number of passes for data, if the stream can be replayed
+   */
+  data_set(stream_reader* stream, unsigned n_passes) :
+    big(false), sparse(false), stream(true), n_samples(0),
+    n_features(stream->n_features()), n_passes_(n_passes), shared_(NULL),
+    subset_(NULL), subset_first_(0), first_(0), big_y_(false), rows_(NULL),
+    rowsf_(NULL), pitch_(0), stride_(1), stream_(stream), chunk_start_(0),
+    pass_start_(0), pass_(1), shuffle_(false), block_shuffle_(false),
+    perm_(0, 0), block_perm_(0, 0, 1, 1) {
+    stream_->read_chunk();
+  }
+
+  /**
+   * Data points of another data set, visited in an order of their own. The
+   * storage of the other data set is shared rather than copied, so it must
+   * outlive this one, and must not be read through a stream or a prefetching
+   * reader.
+   *
+   * @param other    data set whose data points to visit
+   * @param seed     seed of the order in which data points are visited if
+   *                 other shuffles them
+   * @param shuffle_control block size and window for block shuffling
+   */
+  data_set(const data_set& other, unsigned seed, const vec& shuffle_control) :
+    data_set(other, NULL, 0, other.n_samples, other.n_passes_, seed,
+      shuffle_control) {}
+
+  /**
+   * Subsample of the data points of another data set, sharing its storage as
+   * above: the data points at positions first, ..., first+n-1 of a
+   * permutation of the other data set.
+   *
+   * @param other    data set whose data points to visit
+   * @param subset   permutation of the data points of other, or NULL for the
+   *                 identity; it must outlive the data set
+   * @param first    position in subset of the first data point
+   * @param n        number of data points
+   * @param n_passes number of passes for data
+   * @param seed     seed of the order in which data points are visited if
+   *                 other shuffles them
+   * @param shuffle_control block size and window for block shuffling
+   */
+  data_set(const data_set& other, const permutation* subset, unsigned first,
+    unsigned n, unsigned n_passes, unsigned seed,
+    const vec& shuffle_control) :
+    X(const_cast<double*>(other.X.memptr()), other.X.n_rows, other.X.n_cols,
+      false, true),
+    Y(const_cast<double*>(other.Y.memptr()), other.Y.n_rows, other.Y.n_cols,
+      false, true),
+    big(false), sparse(other.sparse), stream(false), n_samples(n),
+    n_features(other.n_features), n_passes_(n_passes), shared_(&other),
+    subset_(subset), subset_first_(first), first_(0), big_y_(false),
+    rows_(other.rows_), rowsf_(other.rowsf_), pitch_(other.pitch_),
+    stride_(other.stride_), chunk_start_(0), pass_start_(0), pass_(1),
+    shuffle_(other.shuffle_), block_shuffle_(other.block_shuffle_),
+    perm_(0, seed), block_perm_(0, seed, 1, 1) {
+    set_order_(seed, shuffle_control);
+  }
+
+  // Make the data points follow @first others, e.g., those of earlier fits of
+  // a model that is updated online: the @t th data point is then the
+  // (t-first) th of the data set. Not for streams.
+  void set_first(unsigned first) {
+    first_ = first;
+  }
+  unsigned first() const {
+    return first_;
+  }
+
+  // Whether there is a @t th data point. Streams are read up to the chunk
+  // holding it.
+  bool has_data_point(unsigned t) const {
+    if (!stream) {
+      return t > first_ && t - first_ <= n_samples * n_passes_;
+    }
+    while (t - 1 >= chunk_start_ + stream_->n_rows()) {
+      chunk_start_ += stream_->n_rows();
+      if (!stream_->read_chunk()) {
+        if (pass_ == n_passes_ || !stream_->rewind() ||
+            !stream_->read_chunk()) {
+          return false;
         }
-        // std::random_shuffle(idxvec_.begin() + i * n_samples,
-        //                     idxvec_.begin() + (i + 1) * n_samples,
-        //                     randWrapper);
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::shuffle(idxvec_.begin() + i * n_samples,
-                            idxvec_.begin() + (i + 1) * n_samples,
-                            gen);
+        pass_ += 1;
+        pass_start_ = chunk_start_;
       }
     }
+    return true;
   }
 
-  // Index to the @t th data point
+  // Index to the @t th data point. The returned data point views the row in
+  // place; no covariates are copied. A data set read from a bigmatrix serves
+  // one thread only, as reading moves its block reader along.
   data_point get_data_point(unsigned t) const {
+    if (stream) {
+      has_data_point(t);
+      unsigned r = t - 1 - chunk_start_;
+      return data_point(stream_->row(r), 1, n_features, stream_->y(r),
+        t - 1 - pass_start_);
+    }
+    t -= first_;
+    if (reader_) {
+      unsigned idx;
+      double y;
+      const double* xt = reader_->get_row(t - 1, idx, y);
+      return data_point(xt, 1, n_features, big_y_ ? y : Y(idx), idx);
+    }
+    if (readerf_) {
+      unsigned idx;
+      double y;
+      const float* xt = readerf_->get_row(t - 1, idx, y);
+      return data_point(xt, 1, n_features, big_y_ ? y : Y(idx), idx);
+    }
     t = idxmap_(t - 1);
-    mat xt;
-    if (!big) {
-      xt = mat(X.row(t));
+    if (sparse) {
+      const sp_mat& sprows = shared_ ? shared_->sprows_ : sprows_;
+      uword begin = sprows.col_ptrs[t];
+      uword end = sprows.col_ptrs[t + 1];
+      return data_point(sprows.values + begin, sprows.row_indices + begin,
+        end - begin, n_features, Y(t), t);
+    } else if (rowsf_) {
+      return data_point(rowsf_ + static_cast<size_t>(t) * pitch_, stride_,
+        n_features, Y(t), t);
+    } else if (rows_) {
+      return data_point(rows_ + static_cast<size_t>(t) * pitch_, 1,
+        n_features, Y(t), t);
     } else {
-      MatrixAccessor<double> matacess(*xpMat_);
-      xt = mat(1, n_features);
-      for (unsigned i=0; i < n_features; ++i) {
-        xt(0, i) = matacess[i][t];
-      }
+      return data_point(X.memptr() + t, X.n_rows, n_features, Y(t), t);
+    }
+  }
+
+  // Covariates of the @n data points from the @t th, as the columns of Xb,
+  // and their responses; fewer are returned at the end of the data.
+  unsigned get_batch(unsigned t, unsigned n, mat& Xb, vec& yb) const {
+    Xb.set_size(n_features, n);
+    yb.set_size(n);
+    unsigned i = 0;
+    for (; i < n && has_data_point(t + i); ++i) {
+      data_point data_pt = get_data_point(t + i);
+      data_pt.copy_to(Xb.colptr(i));
+      yb(i) = data_pt.y;
+    }
+    if (i < n) {
+      Xb.shed_cols(i, n - 1);
+      yb.shed_rows(i, n - 1);
+    }
+    return i;
+  }
+
+  // Whether data points can be read from several threads at once, i.e., not
+  // through a stream or a prefetching reader, which keep state
+  bool concurrent_reads() const {
+    return !stream && !reader_ && !readerf_;
+  }
+
+  // Covariates of the @n data points from the @t th, written densely to
+  // consecutive runs of n_features elements from x, and their responses to y.
+  // All of them must exist.
+  void copy_data_points(unsigned t, unsigned n, double* x, double* y) const {
+    for (unsigned i = 0; i < n; ++i) {
+      data_point data_pt = get_data_point(t + i);
+      data_pt.copy_to(x + static_cast<size_t>(i) * n_features);
+      y[i] = data_pt.y;
     }
-    double yt = Y(t);
-    return data_point(xt, yt, t);
   }
 
   mat X;
   mat Y;
   bool big;
+  bool sparse;
+  bool stream;
   unsigned n_samples;
   unsigned n_features;
 
 private:
-  // index to data point for each iteration
+  // index to data point for each iteration. Shuffled orders are computed on
+  // the fly, a different permutation of the data set in each pass.
   unsigned idxmap_(unsigned t) const {
-    if (shuffle_) {
-      return(idxvec_[t]);
+    unsigned i;
+    if (block_shuffle_) {
+      i = block_perm_(t % n_samples, t / n_samples);
+    } else if (shuffle_) {
+      i = perm_(t % n_samples, t / n_samples);
     } else {
-      return(t % n_samples);
+      i = t % n_samples;
     }
+    return subset_ ? (*subset_)(subset_first_ + i, 0) : subset_first_ + i;
+  }
+
+  void set_order_(unsigned seed, const vec& shuffle_control) {
+    if (block_shuffle_) {
+      block_perm_ = block_permutation(n_samples, seed,
+        static_cast<unsigned>(shuffle_control(0)),
+        static_cast<unsigned>(shuffle_control(1)));
+    } else {
+      perm_ = permutation(n_samples, seed);
+    }
+  }
+
+  // Copy the design matrix into a row-major buffer. Each row is padded to a
+  // whole number of 64-byte cache lines and starts on a cache line boundary.
+  void pack_rows_() {
+    const unsigned line = 64 / sizeof(double);
+    pitch_ = ((n_features + line - 1) / line) * line;
+    packed_buf_ = std::vector<double>(
+      static_cast<size_t>(n_samples) * pitch_ + line - 1, 0.);
+    size_t addr = reinterpret_cast<size_t>(packed_buf_.data());
+    double* packed = packed_buf_.data() +
+      ((64 - addr % 64) % 64) / sizeof(double);
+    for (unsigned j = 0; j < n_features; ++j) {
+      const double* col = X.colptr(j);
+      for (unsigned i = 0; i < n_samples; ++i) {
+        packed[static_cast<size_t>(i) * pitch_ + j] = col[i];
+      }
+    }
+    rows_ = packed;
+  }
+
+  // Copy the design matrix into a single-precision buffer, row by row as in
+  // pack_rows_() or column by column.
+  void pack_single_(bool row_major) {
+    const unsigned line = 64 / sizeof(float);
+    if (row_major) {
+      pitch_ = ((n_features + line - 1) / line) * line;
+    } else {
+      pitch_ = 1;
+      stride_ = n_samples;
+    }
+    size_t n_values = row_major ?
+      static_cast<size_t>(n_samples) * pitch_ :
+      static_cast<size_t>(n_samples) * n_features;
+    packedf_buf_ = std::vector<float>(n_values + line - 1, 0.f);
+    size_t addr = reinterpret_cast<size_t>(packedf_buf_.data());
+    float* packed = packedf_buf_.data() +
+      ((64 - addr % 64) % 64) / sizeof(float);
+    for (unsigned j = 0; j < n_features; ++j) {
+      const double* col = X.colptr(j);
+      for (unsigned i = 0; i < n_samples; ++i) {
+        packed[static_cast<size_t>(i) * pitch_ +
+          static_cast<size_t>(j) * stride_] = static_cast<float>(col[i]);
+      }
+    }
+    rowsf_ = packed;
+  }
+
+  // Element types of a bigmatrix, as coded by BigMatrix::matrix_type(). The
+  // code of double is its size, but that of float is not (4 is int).
+  static const int big_double_ = 8;
+  static const int big_float_ = 6;
+
+  // Reader of the covariates of a bigmatrix, all columns but y_col, and of
+  // the responses if they are in y_col or in ymat.
+  template<typename T>
+  std::unique_ptr<block_reader<T> > make_reader_(
+    const Rcpp::XPtr<BigMatrix>& bigmat, const Rcpp::XPtr<BigMatrix>& ymat,
+    unsigned y_col) {
+    MatrixAccessor<T> matacess(*bigmat);
+    std::vector<const T*> cols;
+    for (unsigned j = 0; j < bigmat->ncol(); ++j) {
+      if (j + 1 != y_col) {
+        cols.push_back(matacess[j]);
+      }
+    }
+    const T* ycol = NULL;
+    if (y_col) {
+      ycol = matacess[y_col - 1];
+    } else if (ymat.get() != NULL) {
+      ycol = MatrixAccessor<T>(*ymat)[0];
+    }
+    // The same map as idxmap_(), holding copies of the order rather than a
+    // pointer to this data set, which may be moved while the reader runs.
+    unsigned n = n_samples;
+    bool shuffle = shuffle_;
+    bool block_shuffle = block_shuffle_;
+    permutation perm = perm_;
+    block_permutation block_perm = block_perm_;
+    return std::unique_ptr<block_reader<T> >(new block_reader<T>(cols, ycol,
+      n_samples * n_passes_, big_block_size_(sizeof(T)),
+      [=](unsigned t) {
+        return block_shuffle ? block_perm(t % n, t / n) :
+          shuffle ? perm(t % n, t / n) : t % n;
+      }));
+  }
+
+  // Number of rows of a bigmatrix read at a time, about 1MB of elements of
+  // the given size.
+  unsigned big_block_size_(size_t elem_size) const {
+    return std::max(1u,
+      static_cast<unsigned>((1u << 20) / elem_size) / n_features);
   }
 
-  Rcpp::XPtr<BigMatrix> xpMat_;
-  std::vector<unsigned> idxvec_;
+  unsigned n_passes_;
+  const data_set* shared_;         // data set whose storage is used, or NULL
+  const permutation* subset_;      // data points of a subsample, or NULL
+  unsigned subset_first_;          // position in subset_ of the first one
+  unsigned first_;                 // data points before the first one
+  sp_mat sprows_;                  // transpose of a sparse X
+  bool big_y_;                     // whether Y is read from a bigmatrix
+  std::unique_ptr<block_reader<double> > reader_; // prefetching reader of
+                                                  // a double bigmatrix
+  std::unique_ptr<block_reader<float> > readerf_; // and of a float one
+  const double* rows_;             // first row if rows are contiguous
+  const float* rowsf_;             // first row if X is in single precision
+  unsigned pitch_;                 // distance between consecutive rows
+  unsigned stride_;                // distance between covariates of rowsf_
+  std::vector<double> packed_buf_; // row-major copy of X
+  std::vector<float> packedf_buf_; // single-precision copy of X
+  std::unique_ptr<data_file> file_;
+  std::unique_ptr<stream_reader> stream_;
+  mutable unsigned chunk_start_;   // iteration of the first row in the chunk
+  mutable unsigned pass_start_;    // iteration of the first row in the pass
+  mutable unsigned pass_;          // current pass over the stream
   bool shuffle_;
+  bool block_shuffle_;
+  permutation perm_;               // order of data points if shuffling
+  block_permutation block_perm_;   // order of data points if block shuffling
 };
 
 #endif
@@ -0,0 +1,117 @@
+#ifndef DATA_PERMUTATION_H
+#define DATA_PERMUTATION_H
+
+#include "../basedef.h"
+
+class permutation {
+  /**
+   * Pseudorandom permutation of [0, n) evaluated one element at a time, so
+   * that no index vector is stored. It is a balanced Feistel network on the
+   * smallest power of 4 at least n, keyed by a seed; images outside [0, n)
+   * are mapped again until they fall inside (cycle walking), which takes
+   * fewer than 4 rounds of the network on average.
+   *
+   * @param n    number of elements
+   * @param seed key of the permutation
+   */
+public:
+  permutation(unsigned n, uint64_t seed) : n_(n), seed_(seed), half_bits_(1) {
+    while ((uint64_t(1) << (2 * half_bits_)) < n_) {
+      ++half_bits_;
+    }
+    half_mask_ = (uint64_t(1) << half_bits_) - 1;
+  }
+
+  // Image of i under the permutation for the @pass th pass; each pass has its
+  // own key.
+  unsigned operator()(unsigned i, unsigned pass) const {
+    uint64_t key = mix_(seed_ + 0x9e3779b97f4a7c15ULL * (pass + 1));
+    uint64_t x = i;
+    do {
+      x = encrypt_(x, key);
+    } while (x >= n_);
+    return static_cast<unsigned>(x);
+  }
+
+private:
+  static const unsigned N_ROUNDS = 4;
+
+  uint64_t encrypt_(uint64_t x, uint64_t key) const {
+    uint64_t left = x >> half_bits_;
+    uint64_t right = x & half_mask_;
+    for (unsigned r = 0; r < N_ROUNDS; ++r) {
+      uint64_t next = left ^ (mix_(right ^ (key + r)) & half_mask_);
+      left = right;
+      right = next;
+    }
+    return (left << half_bits_) | right;
+  }
+
+  // splitmix64 finalizer
+  static uint64_t mix_(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  uint64_t n_;
+  uint64_t seed_;
+  unsigned half_bits_;  // bits in each half of the network's input
+  uint64_t half_mask_;
+};
+
+class block_permutation {
+  /**
+   * Permutation of [0, n) that keeps accesses local: the data set is cut
+   * into blocks of consecutive rows, the blocks are visited in a random
+   * order, and the rows of each window of consecutive blocks in that order
+   * are visited in a random order. Each window of rows can thus be read
+   * sequentially before it is used. The last, partial block is visited in
+   * the last window.
+   *
+   * @param n          number of elements
+   * @param seed       key of the permutation
+   * @param block_size number of rows per block
+   * @param window     number of blocks per window
+   */
+public:
+  block_permutation(unsigned n, uint64_t seed, unsigned block_size,
+    unsigned window) :
+    block_size_(std::max(1u, std::min(block_size, n))),
+    n_blocks_(n / block_size_),
+    window_(std::max(1u, std::min(window, std::max(1u, n_blocks_)))),
+    window_len_(block_size_ * window_),
+    n_windows_(n / window_len_),
+    blocks_(n_windows_ * window_, seed),
+    rows_(window_len_, seed + 1),
+    tail_(n - n_windows_ * window_len_, seed + 2) {}
+
+  unsigned operator()(unsigned i, unsigned pass) const {
+    unsigned w = i / window_len_;
+    unsigned r;
+    if (w < n_windows_) {
+      r = rows_(i % window_len_, pass * n_windows_ + w);
+    } else {
+      r = tail_(i - n_windows_ * window_len_, pass);
+    }
+    // Blocks past the last full windows, including the partial block, are
+    // only shuffled among themselves, so that all other blocks are full.
+    unsigned b = w * window_ + r / block_size_;
+    if (b < n_windows_ * window_) {
+      b = blocks_(b, pass);
+    }
+    return b * block_size_ + r % block_size_;
+  }
+
+private:
+  unsigned block_size_;
+  unsigned n_blocks_;    // number of full blocks
+  unsigned window_;
+  unsigned window_len_;  // number of rows in a window
+  unsigned n_windows_;   // number of full windows
+  permutation blocks_;   // order of blocks in full windows
+  permutation rows_;     // order of rows within a full window
+  permutation tail_;     // order of rows after the last full window
+};
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef DATA_STREAM_READER_H
+#define DATA_STREAM_READER_H
+
+#include "../basedef.h"
+#include <cstdio>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+class stream_reader {
+  /**
+   * Sequential reader of observations from a file or pipe, holding a fixed
+   * number of rows in memory at a time. Records are either lines of comma
+   * separated values, or binary records of n_cols doubles in native byte
+   * order.
+   *
+   * @param file       path of the file, or command whose output is read if
+   *                   pipe is set
+   * @param format     "csv" or "binary"
+   * @param n_cols     number of values in each record, including the response
+   * @param y_col      (zero-based) position of the response in a record
+   * @param chunk_size number of rows held in memory
+   * @param header     whether the first line of a csv is a header
+   * @param pipe       whether file is a command to read the output of
+   */
+public:
+  stream_reader(std::string file, std::string format, unsigned n_cols,
+    unsigned y_col, unsigned chunk_size, bool header, bool pipe) :
+    file_(file), binary_(format == "binary"), n_cols_(n_cols),
+    y_col_(y_col), chunk_size_(chunk_size), header_(header), pipe_(pipe),
+    fp_(NULL), n_rows_(0), done_(false) {
+    x_ = std::vector<double>(static_cast<size_t>(chunk_size_) * n_features());
+    y_ = std::vector<double>(chunk_size_);
+    record_ = std::vector<double>(n_cols_);
+    open_();
+  }
+
+  ~stream_reader() {
+    close_();
+  }
+
+  unsigned n_features() const {
+    return n_cols_ - 1;
+  }
+
+  // Number of rows in the current chunk
+  unsigned n_rows() const {
+    return n_rows_;
+  }
+
+  const double* row(unsigned r) const {
+    return x_.data() + static_cast<size_t>(r) * n_features();
+  }
+
+  double y(unsigned r) const {
+    return y_[r];
+  }
+
+  // Replace the current chunk with the next rows of the stream. Returns false
+  // once the stream is exhausted.
+  bool read_chunk() {
+    n_rows_ = 0;
+    while (!done_ && n_rows_ < chunk_size_) {
+      if (!read_record_()) {
+        done_ = true;
+        break;
+      }
+      double* xr = x_.data() + static_cast<size_t>(n_rows_) * n_features();
+      for (unsigned i = 0, j = 0; i < n_cols_; ++i) {
+        if (i == y_col_) {
+          y_[n_rows_] = record_[i];
+        } else {
+          xr[j++] = record_[i];
+        }
+      }
+      ++n_rows_;
+    }
+    return n_rows_ > 0;
+  }
+
+  // Start again from the beginning of a file. Pipes cannot be replayed.
+  bool rewind() {
+    if (pipe_) {
+      return false;
+    }
+    close_();
+    open_();
+    done_ = (fp_ == NULL);
+    return !done_;
+  }
+
+private:
+  void open_() {
+    if (pipe_) {
+      fp_ = popen(file_.c_str(), binary_ ? "rb" : "r");
+    } else {
+      fp_ = fopen(file_.c_str(), binary_ ? "rb" : "r");
+    }
+    if (fp_ == NULL) {
+      Rcpp::stop("cannot open data stream '" + file_ + "'");
+    }
+    if (!binary_ && header_) {
+      next_line_();
+    }
+  }
+
+  void close_() {
+    if (fp_ != NULL) {
+      if (pipe_) {
+        pclose(fp_);
+      } else {
+        fclose(fp_);
+      }
+      fp_ = NULL;
+    }
+  }
+
+  // Read the next line into line_, without its line ending.
+  bool next_line_() {
+    line_.clear();
+    int c;
+    while ((c = fgetc(fp_)) != EOF && c != '\n') {
+      if (c != '\r') {
+        line_.push_back(static_cast<char>(c));
+      }
+    }
+    line_.push_back('\0');
+    return c != EOF || line_.size() > 1;
+  }
+
+  bool read_record_() {
+    if (binary_) {
+      return fread(record_.data(), sizeof(double), n_cols_, fp_) == n_cols_;
+    }
+    do {
+      if (!next_line_()) {
+        return false;
+      }
+    } while (line_[0] == '\0'); // skip blank lines
+    const char* p = line_.data();
+    for (unsigned i = 0; i < n_cols_; ++i) {
+      char* end;
+      record_[i] = strtod(p, &end);
+      if (end == p) {
+        Rcpp::stop("malformed record in data stream '" + file_ + "'");
+      }
+      p = end;
+      while (*p == ',' || *p == ' ' || *p == '\t') {
+        ++p;
+      }
+    }
+    return true;
+  }
+
+  std::string file_;
+  bool binary_;
+  unsigned n_cols_;
+  unsigned y_col_;
+  unsigned chunk_size_;
+  bool header_;
+  bool pipe_;
+  FILE* fp_;
+  std::vector<double> x_;      // row-major covariates of the current chunk
+  std::vector<double> y_;      // responses of the current chunk
+  std::vector<double> record_; // values of the record being parsed
+  std::vector<char> line_;     // text of the line being parsed
+  unsigned n_rows_;            // rows in the current chunk
+  bool done_;                  // whether the stream is exhausted
+};
+
+#endif
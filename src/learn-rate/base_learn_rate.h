@@ -12,6 +12,19 @@ public:
   base_learn_rate() {}
 
   virtual const learn_rate_value& operator()(unsigned t, const mat& grad_t) = 0;
+
+  // Copy of the learning rate in its current state, e.g., for another thread
+  virtual base_learn_rate* clone() const = 0;
+
+  // State that the learning rate accumulates over iterations, e.g., for a
+  // checkpoint, and setting it back; set_state() returns whether the state
+  // fits the learning rate.
+  virtual vec state() const {
+    return vec();
+  }
+  virtual bool set_state(const vec& state) {
+    return state.n_elem == 0;
+  }
 };
 
 #endif
@@ -42,6 +42,21 @@ public:
     return v_;
   }
 
+  virtual base_learn_rate* clone() const {
+    return new ddim_learn_rate(*this);
+  }
+
+  virtual vec state() const {
+    return Idiag_;
+  }
+  virtual bool set_state(const vec& state) {
+    if (state.n_elem != d_) {
+      return false;
+    }
+    Idiag_ = state;
+    return true;
+  }
+
 private:
   unsigned d_;
   vec Idiag_;
@@ -53,6 +53,16 @@ public:
   //   return at(i, j);
   // }
 
+  // Type of the value; 0 is scalar, 1 is vector, 2 is matrix
+  unsigned type() const {
+    return type_;
+  }
+
+  // Diagonal of a vector value
+  const vec& vector() const {
+    return lr_vector_;
+  }
+
   // Take average for usage in implicit SGD
   double mean() const {
     // double average = 0.0;
@@ -65,7 +75,7 @@ public:
     }
   }
 
-  learn_rate_value operator=(double scalar) {
+  learn_rate_value& operator=(double scalar) {
     if (type_ == 0) {
       lr_scalar_ = scalar;
     } else {
@@ -76,7 +86,7 @@ public:
     return *this;
   }
 
-  learn_rate_value operator=(const vec& vector) {
+  learn_rate_value& operator=(const vec& vector) {
     if (type_ == 1) {
       lr_vector_ = vector;
     } else {
@@ -87,7 +97,7 @@ public:
     return *this;
   }
 
-  learn_rate_value operator=(const mat& matrix) {
+  learn_rate_value& operator=(const mat& matrix) {
     if (type_ == 2) {
       lr_matrix_ = matrix;
     } else {
@@ -119,6 +129,20 @@ public:
     }
   }
 
+  // out += learning rate * matrix, without temporaries. A matrix-valued rate
+  // forms its product in a buffer kept between calls, which is allocated
+  // once.
+  void add_scaled(mat& out, const mat& matrix) const {
+    if (type_ == 0) {
+      out += lr_scalar_ * matrix;
+    } else if (type_ == 1) {
+      out += lr_vector_ % matrix;
+    } else {
+      product_ = lr_matrix_ * matrix;
+      out += product_;
+    }
+  }
+
   bool operator<(const double thres) {
     if (type_ == 0) {
       return lr_scalar_ < thres;
@@ -138,6 +162,7 @@ private:
   double lr_scalar_;
   vec lr_vector_;
   mat lr_matrix_;
+  mutable mat product_;  // lr_matrix_ * matrix in add_scaled()
 };
 
 #endif
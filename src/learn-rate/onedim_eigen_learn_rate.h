@@ -26,6 +26,10 @@ public:
     return v_;
   }
 
+  virtual base_learn_rate* clone() const {
+    return new onedim_eigen_learn_rate(*this);
+  }
+
 private:
   unsigned d_;
   learn_rate_value v_;
@@ -23,6 +23,10 @@ public:
     return v_;
   }
 
+  virtual base_learn_rate* clone() const {
+    return new onedim_learn_rate(*this);
+  }
+
 private:
   double scale_;
   double gamma_;
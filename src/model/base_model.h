@@ -3,6 +3,8 @@
 
 #include "../basedef.h"
 #include "../data/data_point.h"
+#include "../data/data_set.h"
+#include "../parallel/thread_pool.h"
 
 class base_model {
   /**
@@ -25,24 +27,114 @@ public:
   mat gradient_penalty(const mat& theta) const {
     return lambda1_*sign(theta) + lambda2_*theta;
   }
+  // out += a * grad(penalty), in place
+  void add_gradient_penalty(mat& out, double a, const mat& theta) const {
+    out += (a*lambda1_)*sign(theta) + (a*lambda2_)*theta;
+  }
+  bool has_penalty() const {
+    return lambda1_ != 0 || lambda2_ != 0;
+  }
 
   // Functions for implicit update
   // Following the JSS paper, we assume C_n = identity, lambda = 1, and use ksi
-  // rather than s_n, which is slightly less efficient.
-  // ell'(x^T theta + at x^T grad(penalty) + ksi ||x||^2)
-  double scale_factor(double ksi, double at, const data_point& data_pt, const
-    mat& theta_old, double normx) const;
-  // d/d(ksi) ell'
-  double scale_factor_first_deriv(double ksi, double at, const data_point&
-    data_pt, const mat& theta_old, double normx) const;
-  // d^2/d(ksi)^2 ell'
-  double scale_factor_second_deriv(double ksi, double at, const data_point&
-    data_pt, const mat& theta_old, double normx) const;
+  // rather than s_n, which is slightly less efficient. The update is
+  //   theta_new = theta_old - at grad(penalty) + ksi x,
+  // so x^T theta_new = eta + ksi ||x||^2 for the linear predictor
+  //   eta = x^T theta_old - at x^T grad(penalty),
+  // which is computed once per data point from x_theta = x^T theta_old,
+  // touching only its nonzero covariates.
+  double implicit_eta(const data_point& data_pt, const mat& theta_old,
+    double x_theta, double at) const {
+    double eta = x_theta * (1 - at*lambda2_);
+    if (lambda1_ != 0) {
+      eta -= at*lambda1_*data_pt.dot_sign(theta_old);
+    }
+    return eta;
+  }
+  // Negative derivative of the loss in the linear predictor, at
+  // eta + ksi ||x||^2
+  double scale_factor(double ksi, double eta, double y, double normx) const;
+  // -d/d(ksi) of the scale factor
+  double scale_factor_first_deriv(double ksi, double eta, double y,
+    double normx) const;
+  // -d^2/d(ksi)^2 of the scale factor
+  double scale_factor_second_deriv(double ksi, double eta, double y,
+    double normx) const;
+  // Solves ksi = at scale_factor(ksi, ...) in closed form into ksi, if the
+  // model allows, and returns whether it did.
+  bool implicit_closed_form(double at, double eta, double y, double normx,
+    double& ksi) const;
 
 protected:
+  // Mean gradient over the @n data points from the @t th, at each column of
+  // theta_old, written in place into grad_t; resid(y, eta) is the factor of
+  // the covariates in the gradient of the loss at a data point. The batch is
+  // split into slices of batch_slice data points, each gathered and multiplied
+  // out on its own by a thread of the pool, and the partial gradients of the
+  // slices are summed in a fixed tree order. As the slices depend only on the
+  // batch, the result is the same for any number of threads.
+  template<typename RESID>
+  void batch_gradient(unsigned t, unsigned n, const mat& theta_old,
+    const data_set& data, mat& grad_t, thread_pool& pool, RESID resid) const {
+    const unsigned d = theta_old.n_rows;
+    const unsigned k = theta_old.n_cols;
+    const bool gather = data.concurrent_reads();
+    if (gather) {
+      while (n > 0 && !data.has_data_point(t + n - 1)) {
+        --n;
+      }
+      Xb_.set_size(d, n);
+      yb_.set_size(n);
+    } else {
+      n = data.get_batch(t, n, Xb_, yb_);
+    }
+    unsigned n_slices = (n + batch_slice - 1) / batch_slice;
+    r_.set_size(k, n);
+    partials_.set_size(d, k * std::max(n_slices, 1u));
+    partials_.zeros();
+
+    pool.run(n_slices, [&](unsigned s) {
+      unsigned first = s * batch_slice;
+      unsigned len = (n - first < batch_slice) ? n - first : batch_slice;
+      if (gather) {
+        data.copy_data_points(t + first, len, Xb_.colptr(first),
+          yb_.memptr() + first);
+      }
+      // Views into the slice's columns, so no memory is allocated.
+      mat Xs(Xb_.colptr(first), d, len, false, true);
+      mat rs(r_.colptr(first), k, len, false, true);
+      mat part(partials_.colptr(s * k), d, k, false, true);
+      rs = theta_old.t() * Xs;
+      for (unsigned i = 0; i < len; ++i) {
+        for (unsigned j = 0; j < k; ++j) {
+          rs(j, i) = resid(yb_(first + i), rs(j, i));
+        }
+      }
+      part = Xs * rs.t();
+    });
+
+    for (unsigned step = 1; step < n_slices; step *= 2) {
+      for (unsigned s = 0; s + step < n_slices; s += 2 * step) {
+        partials_.cols(s * k, s * k + k - 1) +=
+          partials_.cols((s + step) * k, (s + step) * k + k - 1);
+      }
+    }
+    grad_t = partials_.cols(0, k - 1);
+    grad_t /= std::max(n, 1u);
+    if (has_penalty()) {
+      add_gradient_penalty(grad_t, -1., theta_old);
+    }
+  }
+
+  static const unsigned batch_slice = 64; // data points per slice of a batch
+
   std::string name_;
   double lambda1_;
   double lambda2_;
+  mutable mat Xb_;       // covariates of a batch, one column per data point
+  mutable vec yb_;       // responses of a batch
+  mutable mat r_;        // residuals of a batch, one column per data point
+  mutable mat partials_; // gradient of each slice of a batch, side by side
 };
 
 #endif
@@ -9,37 +9,154 @@ class cox_model : public base_model {
   /**
    * Cox proportional hazards model
    *
-   * @param model attributes affiliated with model as R type
+   * The gradient at a data point j is x_j (d_j - exp(x_j^T theta) H_j), with
+   * d_j its event indicator and H_j the (Breslow) cumulative baseline hazard
+   * at its time,
+   *   H_j = sum over event times s <= t_j of (events at s) / S(s),
+   *   S(s) = sum over data points i at risk at s, t_i >= s, of
+   *          exp(x_i^T theta).
+   * Rather than evaluating every risk score at each step, the risk score of a
+   * data point is cached whenever it is visited, and the hazards are
+   * recomputed from the cached scores once every n_samples visits, i.e.,
+   * once per pass, in O(n_samples) time. A visit is the first evaluation at
+   * an iteration: a method that evaluates the gradient of a data point at
+   * several estimates, e.g., Nesterov's at the extrapolated one and at the
+   * current one, caches only the score at the first of them. A step then
+   * takes O(d) time, amortized, and reads only its own data point, so any
+   * data set that can be visited works. Until they are visited, the risk
+   * scores are those at theta = 0.
+   *
+   * @param model attributes affiliated with model as R type; "time", if
+   *              given, holds the times of the data points, which are sorted
+   *              once, and data points at equal times are at risk at each
+   *              other's time; otherwise the data points are taken to be in
+   *              order of time, without ties
    */
 public:
-  cox_model(Rcpp::List model) : base_model(model) {}
+  cox_model(Rcpp::List model) : base_model(model), n_visits_(0),
+    last_t_(0) {
+    if (model.containsElementNamed("time")) {
+      time_ = Rcpp::as<vec>(model["time"]);
+    }
+  }
 
   mat gradient(unsigned t, const mat& theta_old, const data_set& data)
     const {
+    mat grad_t(theta_old.n_rows, 1);
+    gradient(t, theta_old, data, grad_t);
+    return grad_t;
+  }
+
+  // Gradient written in place into grad_t, of the size of theta_old
+  void gradient(unsigned t, const mat& theta_old, const data_set& data,
+    mat& grad_t) const {
     data_point data_pt = data.get_data_point(t);
-    unsigned j = data_pt.idx;
-
-    // assuming data points fail in order, i.e., risk set R_i={i,i+1,...,n}
-    vec xi = exp(data.X * theta_old);
-    vec h = zeros<vec>(j);
-    double sum_xi = 0;
-    for (int i = j-1; i < j; --i) {
-      // h_i = d_i/sum(xi[i:n])
-      if (i == j-1) {
-        for (int k = i; k < data.n_samples; ++k) {
-          sum_xi += xi(k);
-        }
-      } else {
-        sum_xi += xi(i);
+    double eta = data_pt.dot(theta_old);
+    double r = data_pt.y - exp(eta) * cumulative_hazard(t, data_pt, eta,
+      data);
+    grad_t.zeros();
+    data_pt.add_to(grad_t, r);
+  }
+
+  // Mean gradient over the @n data points from the @t th, at each column of
+  // theta_old, computed serially
+  void gradient(unsigned t, unsigned n, const mat& theta_old,
+    const data_set& data, mat& grad_t, thread_pool& pool) const {
+    grad_t.zeros(theta_old.n_rows, theta_old.n_cols);
+    unsigned i = 0;
+    for (; i < n && data.has_data_point(t + i); ++i) {
+      for (unsigned j = 0; j < theta_old.n_cols; ++j) {
+        grad_t.col(j) += gradient(t + i, theta_old.col(j), data);
       }
-      h(i) = data.Y(i)/sum_xi;
     }
-    double r = data_pt.y - xi(j) * sum(h);
-    return (r * data_pt.x).t();
+    grad_t /= std::max(i, 1u);
+  }
+
+  // Cumulative baseline hazard at the time of the data point of the @t th
+  // iteration, whose linear predictor is eta. If this is the first evaluation
+  // at the iteration, its risk score exp(eta) is cached for the next update
+  // of the hazards.
+  double cumulative_hazard(unsigned t, const data_point& data_pt, double eta,
+    const data_set& data) const {
+    if (risk_.n_elem != data.n_samples) {
+      prepare_(data);
+    }
+    if (t != last_t_) {
+      last_t_ = t;
+      risk_(data_pt.idx) = exp(eta);
+      n_visits_ += 1;
+      if (n_visits_ >= data.n_samples) {
+        update_hazards_(data);
+        n_visits_ = 0;
+      }
+    }
+    return hazard_(data_pt.idx);
   }
 
   // TODO
   bool rank;
+
+private:
+  // Sort the data points by time, once, and start from risk scores of 1.
+  void prepare_(const data_set& data) const {
+    unsigned n = data.n_samples;
+    if (time_.n_elem == 0) {
+      order_ = regspace<uvec>(0, n - 1);
+    } else if (time_.n_elem == n) {
+      order_ = stable_sort_index(time_, "ascend");
+    } else {
+      Rcpp::stop("'time' must have a value for each observation");
+    }
+    risk_ = ones<vec>(n);
+    hazard_ = zeros<vec>(n);
+    at_risk_ = zeros<vec>(n);
+    n_visits_ = 0;
+    last_t_ = 0;
+    update_hazards_(data);
+  }
+
+  // Recompute the hazards from the cached risk scores: the sums over the
+  // risk sets are suffix sums in order of time, and the hazards prefix sums
+  // over groups of tied times.
+  void update_hazards_(const data_set& data) const {
+    unsigned n = order_.n_elem;
+    double sum = 0;
+    for (unsigned p = n; p-- > 0; ) {
+      sum += risk_(order_(p));
+      at_risk_(p) = sum;
+    }
+    double cum = 0;
+    for (unsigned p = 0; p < n; ) {
+      unsigned q = p + 1;
+      while (q < n && tied_(order_(p), order_(q))) {
+        ++q;
+      }
+      double events = 0;
+      for (unsigned k = p; k < q; ++k) {
+        events += data.Y(order_(k));
+      }
+      if (events != 0) {
+        cum += events / at_risk_(p);
+      }
+      for (unsigned k = p; k < q; ++k) {
+        hazard_(order_(k)) = cum;
+      }
+      p = q;
+    }
+  }
+
+  bool tied_(unsigned i, unsigned j) const {
+    return time_.n_elem != 0 && time_(i) == time_(j);
+  }
+
+  vec time_;                   // times of the data points, if given
+  mutable uvec order_;         // data points in order of time
+  mutable vec risk_;           // cached risk score of each data point
+  mutable vec hazard_;         // cumulative baseline hazard of each
+  mutable vec at_risk_;        // sum of risk scores at risk, by position in
+                               // order of time
+  mutable unsigned n_visits_;  // visits since the hazards were updated
+  mutable unsigned last_t_;    // iteration of the last visit
 };
 
 #endif
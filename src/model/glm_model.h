@@ -37,13 +37,55 @@ public:
     } else if (transfer_ == "logistic") {
       transfer_obj_ = new logistic_transfer();
     }
+    identity_ = (transfer_ == "identity");
   }
 
   mat gradient(unsigned t, const mat& theta_old, const data_set& data)
     const {
+    mat grad_t(theta_old.n_rows, 1);
+    gradient(t, theta_old, data, grad_t);
+    return grad_t;
+  }
+
+  // Gradient written in place into grad_t, of the size of theta_old
+  void gradient(unsigned t, const mat& theta_old, const data_set& data,
+    mat& grad_t) const {
     data_point data_pt = data.get_data_point(t);
-    return ((data_pt.y - h_transfer(dot(data_pt.x, theta_old))) *
-      data_pt.x).t() - gradient_penalty(theta_old);
+    grad_t.zeros();
+    if (has_penalty()) {
+      add_gradient_penalty(grad_t, -1., theta_old);
+    }
+    data_pt.add_to(grad_t, gradient_scale(data_pt, theta_old));
+  }
+
+  // Factor of the covariates in the gradient of the loss at a data point,
+  // i.e., the gradient without penalty is gradient_scale * x
+  double gradient_scale(const data_point& data_pt, const mat& theta_old)
+    const {
+    return gradient_scale(data_pt.y, data_pt.dot(theta_old));
+  }
+
+  // The same for a response y and its linear predictor eta, to share them
+  // between the steps of an update
+  double gradient_scale(double y, double eta) const {
+    return y - h_transfer(eta);
+  }
+
+  // Loss at a data point, its contribution to the deviance
+  double loss(const data_point& data_pt, const mat& theta) const {
+    mat y(1, 1), mu(1, 1), wt(1, 1);
+    y(0, 0) = data_pt.y;
+    mu(0, 0) = h_transfer(data_pt.dot(theta));
+    wt(0, 0) = 1.;
+    return family_obj_->deviance(y, mu, wt);
+  }
+
+  // Mean gradient over the @n data points from the @t th, at each column of
+  // theta_old, written in place into grad_t; see base_model::batch_gradient.
+  void gradient(unsigned t, unsigned n, const mat& theta_old,
+    const data_set& data, mat& grad_t, thread_pool& pool) const {
+    batch_gradient(t, n, theta_old, data, grad_t, pool,
+      [this](double y, double eta) { return gradient_scale(y, eta); });
   }
 
   double g_link(double u) const {
@@ -86,29 +128,29 @@ public:
     return transfer_;
   }
 
-  // Functions for implicit update
-  double scale_factor(double ksi, double at, const data_point& data_pt, const
-    mat& theta_old, double normx) const {
-    return data_pt.y - h_transfer(
-      dot(theta_old, data_pt.x) -
-      at * dot(gradient_penalty(theta_old), data_pt.x) +
-      ksi * normx);
+  // Functions for implicit update; see base_model
+  double scale_factor(double ksi, double eta, double y, double normx) const {
+    return y - h_transfer(eta + ksi * normx);
+  }
+
+  double scale_factor_first_deriv(double ksi, double eta, double y,
+    double normx) const {
+    return h_first_deriv(eta + ksi * normx) * normx;
   }
 
-  double scale_factor_first_deriv(double ksi, double at, const data_point&
-    data_pt, const mat& theta_old, double normx) const {
-    return h_first_deriv(
-      dot(theta_old, data_pt.x) -
-      at * dot(gradient_penalty(theta_old), data_pt.x) +
-      ksi * normx) * normx;
+  double scale_factor_second_deriv(double ksi, double eta, double y,
+    double normx) const {
+    return h_second_deriv(eta + ksi * normx) * normx * normx;
   }
 
-  double scale_factor_second_deriv(double ksi, double at, const data_point&
-    data_pt, const mat& theta_old, double normx) const {
-    return h_second_deriv(
-      dot(theta_old, data_pt.x) -
-      at * dot(gradient_penalty(theta_old), data_pt.x) +
-      ksi * normx) * normx * normx;
+  // With the identity transfer, ksi = at (y - eta - ksi ||x||^2) is linear.
+  bool implicit_closed_form(double at, double eta, double y, double normx,
+    double& ksi) const {
+    if (!identity_) {
+      return false;
+    }
+    ksi = at * (y - eta) / (1 + at * normx);
+    return true;
   }
 
 private:
@@ -116,6 +158,7 @@ private:
   std::string transfer_;
   base_family* family_obj_;
   base_transfer* transfer_obj_;
+  bool identity_; // whether the transfer is the identity
 };
 
 #endif
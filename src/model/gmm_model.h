@@ -29,13 +29,35 @@ public:
     // TODO include weighting matrix
     Rcpp::NumericVector r_theta_old =
       Rcpp::as<Rcpp::NumericVector>(Rcpp::wrap(theta_old));
-    Rcpp::NumericVector r_data_pt =
-      Rcpp::as<Rcpp::NumericVector>(Rcpp::wrap(data_pt.x));
+    Rcpp::NumericVector r_data_pt(data_pt.n_features);
+    for (unsigned i = 0; i < data_pt.n_features; ++i) {
+      r_data_pt[i] = data_pt.at(i);
+    }
     Rcpp::NumericMatrix r_out = gr_(r_theta_old, r_data_pt);
     mat out = Rcpp::as<mat>(r_out);
     return -1. * out; // maximize the negative moment function
   }
 
+  // Gradient written into grad_t
+  void gradient(unsigned t, const mat& theta_old, const data_set& data,
+    mat& grad_t) const {
+    grad_t = gradient(t, theta_old, data);
+  }
+
+  // Mean gradient over the @n data points from the @t th, at each column of
+  // theta_old, computed serially, as the gradient calls into R
+  void gradient(unsigned t, unsigned n, const mat& theta_old,
+    const data_set& data, mat& grad_t, thread_pool& pool) const {
+    grad_t.zeros(theta_old.n_rows, theta_old.n_cols);
+    unsigned i = 0;
+    for (; i < n && data.has_data_point(t + i); ++i) {
+      for (unsigned j = 0; j < theta_old.n_cols; ++j) {
+        grad_t.col(j) += gradient(t + i, theta_old.col(j), data);
+      }
+    }
+    grad_t /= std::max(i, 1u);
+  }
+
   // TODO
   bool rank;
 
@@ -13,6 +13,12 @@ public:
   virtual double first_derivative(double u, double lambda) const = 0;
   virtual double second_derivative(double u, double lambda) const = 0;
   virtual double third_derivative(double u, double lambda) const = 0;
+  // Solves ksi = a psi(u - c ksi) for ksi in closed form, where psi is the
+  // first derivative, and returns whether it did.
+  virtual bool implicit_step(double u, double a, double c, double lambda,
+    double& ksi) const {
+    return false;
+  }
   virtual mat loss(const mat& u, double lambda) const {
     mat result = mat(u);
     for (unsigned i = 0; i < result.n_rows; ++i) {
@@ -59,6 +65,19 @@ public:
     return 0.0;
   }
 
+  // The residual u - c ksi ends either in the quadratic region, where
+  // ksi = a u/(1 + a c), or past lambda on the side of u, where
+  // ksi = a lambda sign(u).
+  virtual bool implicit_step(double u, double a, double c, double lambda,
+    double& ksi) const {
+    if (std::abs(u) <= lambda * (1 + a*c)) {
+      ksi = a*u / (1 + a*c);
+    } else {
+      ksi = a*lambda*sign(u);
+    }
+    return true;
+  }
+
 private:
   template<typename T>
   double sign(const T& x) const {
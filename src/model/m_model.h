@@ -25,42 +25,73 @@ public:
 
   mat gradient(unsigned t, const mat& theta_old, const data_set& data)
     const {
+    mat grad_t(theta_old.n_rows, 1);
+    gradient(t, theta_old, data, grad_t);
+    return grad_t;
+  }
+
+  // Gradient written in place into grad_t, of the size of theta_old
+  void gradient(unsigned t, const mat& theta_old, const data_set& data,
+    mat& grad_t) const {
     data_point data_pt = data.get_data_point(t);
-    return (loss_obj_->first_derivative(
-      data_pt.y - dot(data_pt.x, theta_old), lambda_) * data_pt.x).t() -
-      gradient_penalty(theta_old);
+    grad_t.zeros();
+    if (has_penalty()) {
+      add_gradient_penalty(grad_t, -1., theta_old);
+    }
+    data_pt.add_to(grad_t, gradient_scale(data_pt, theta_old));
+  }
+
+  // Factor of the covariates in the gradient of the loss at a data point,
+  // i.e., the gradient without penalty is gradient_scale * x
+  double gradient_scale(const data_point& data_pt, const mat& theta_old)
+    const {
+    return gradient_scale(data_pt.y, data_pt.dot(theta_old));
+  }
+
+  // The same for a response y and its linear predictor eta, to share them
+  // between the steps of an update
+  double gradient_scale(double y, double eta) const {
+    return loss_obj_->first_derivative(y - eta, lambda_);
+  }
+
+  // Loss at a data point
+  double loss(const data_point& data_pt, const mat& theta) const {
+    return loss_obj_->loss(data_pt.y - data_pt.dot(theta), lambda_);
+  }
+
+  // Mean gradient over the @n data points from the @t th, at each column of
+  // theta_old, written in place into grad_t; see base_model::batch_gradient.
+  void gradient(unsigned t, unsigned n, const mat& theta_old,
+    const data_set& data, mat& grad_t, thread_pool& pool) const {
+    batch_gradient(t, n, theta_old, data, grad_t, pool,
+      [this](double y, double eta) { return gradient_scale(y, eta); });
   }
 
   std::string loss() const {
     return loss_;
   }
 
-  // Functions for implicit update
-  double scale_factor(double ksi, double at, const data_point& data_pt, const
-    mat& theta_old, double normx) const {
-    return loss_obj_->first_derivative(
-      data_pt.y - dot(theta_old, data_pt.x) -
-        at * dot(gradient_penalty(theta_old), data_pt.x) +
-        ksi * normx,
-      lambda_);
+  // Functions for implicit update; see base_model. The residual at the new
+  // estimate is y - eta - ksi ||x||^2.
+  double scale_factor(double ksi, double eta, double y, double normx) const {
+    return loss_obj_->first_derivative(y - eta - ksi * normx, lambda_);
+  }
+
+  double scale_factor_first_deriv(double ksi, double eta, double y,
+    double normx) const {
+    return loss_obj_->second_derivative(y - eta - ksi * normx, lambda_) *
+      normx;
   }
 
-  double scale_factor_first_deriv(double ksi, double at, const data_point&
-    data_pt, const mat& theta_old, double normx) const {
-    return loss_obj_->second_derivative(
-      data_pt.y - dot(theta_old, data_pt.x) -
-        at * dot(gradient_penalty(theta_old), data_pt.x) +
-        ksi * normx,
-      lambda_) * normx;
+  double scale_factor_second_deriv(double ksi, double eta, double y,
+    double normx) const {
+    return -loss_obj_->third_derivative(y - eta - ksi * normx, lambda_) *
+      normx * normx;
   }
 
-  double scale_factor_second_deriv(double ksi, double at, const data_point&
-    data_pt, const mat& theta_old, double normx) const {
-    return loss_obj_->third_derivative(
-      data_pt.y - dot(theta_old, data_pt.x) -
-        at * dot(gradient_penalty(theta_old), data_pt.x) +
-        ksi * normx,
-      lambda_) * normx * normx;
+  bool implicit_closed_form(double at, double eta, double y, double normx,
+    double& ksi) const {
+    return loss_obj_->implicit_step(y - eta, at, normx, lambda_, ksi);
   }
 
 private:
@@ -0,0 +1,118 @@
+#ifndef PARALLEL_THREAD_POOL_H
+#define PARALLEL_THREAD_POOL_H
+
+#include "../basedef.h"
+
+class thread_pool {
+  /**
+   * Fixed set of threads that run the tasks of a parallel loop. The calling
+   * thread takes part in each loop, so a pool of one thread runs the tasks
+   * inline. Tasks must not call into R. The first exception thrown by a task
+   * stops the loop from handing out more tasks, and is rethrown by run() on
+   * the calling thread once all threads are done.
+   *
+   * @param n_threads number of threads, including the calling one
+   */
+public:
+  thread_pool(unsigned n_threads) :
+    task_(NULL), n_tasks_(0), next_(0), generation_(0), n_busy_(0),
+    stop_(false) {
+    for (unsigned k = 1; k < n_threads; ++k) {
+      workers_.push_back(std::thread(&thread_pool::work_, this));
+    }
+  }
+
+  ~thread_pool() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    start_.notify_all();
+    for (unsigned k = 0; k < workers_.size(); ++k) {
+      workers_[k].join();
+    }
+  }
+
+  unsigned size() const {
+    return workers_.size() + 1;
+  }
+
+  // Run task(i) for i = 0, ..., n_tasks-1 and wait until all are done. Tasks
+  // are handed out in order, but may run in any order.
+  void run(unsigned n_tasks, const std::function<void(unsigned)>& task) {
+    if (workers_.empty() || n_tasks <= 1) {
+      for (unsigned i = 0; i < n_tasks; ++i) {
+        task(i);
+      }
+      return;
+    }
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      task_ = &task;
+      n_tasks_ = n_tasks;
+      next_ = 0;
+      n_busy_ = workers_.size();
+      generation_ += 1;
+    }
+    start_.notify_all();
+    do_tasks_();
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return n_busy_ == 0; });
+    task_ = NULL;
+    if (error_) {
+      std::exception_ptr error = error_;
+      error_ = nullptr;
+      std::rethrow_exception(error);
+    }
+  }
+
+private:
+  // An exception escaping a worker would terminate R, so it is kept for
+  // run() instead.
+  void do_tasks_() {
+    try {
+      for (unsigned i = next_++; i < n_tasks_; i = next_++) {
+        (*task_)(i);
+      }
+    } catch (...) {
+      next_ = n_tasks_;
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+    }
+  }
+
+  void work_() {
+    unsigned seen = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        start_.wait(lock, [&] { return stop_ || generation_ != seen; });
+        if (stop_) {
+          return;
+        }
+        seen = generation_;
+      }
+      do_tasks_();
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (--n_busy_ == 0) {
+        done_.notify_one();
+      }
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable start_;  // signals a new loop, or stopping
+  std::condition_variable done_;   // signals that all workers are done
+  const std::function<void(unsigned)>* task_;
+  unsigned n_tasks_;
+  std::atomic<unsigned> next_;     // next task to hand out
+  unsigned generation_;            // number of loops started
+  unsigned n_busy_;                // workers not done with the current loop
+  std::exception_ptr error_;       // first exception of the current loop
+  bool stop_;
+};
+
+#endif
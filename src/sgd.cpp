@@ -9,6 +9,7 @@
 #include "post-process/gmm_post_process.h"
 #include "post-process/m_post_process.h"
 #include "sgd/explicit_sgd.h"
+#include "sgd/holdout_monitor.h"
 #include "sgd/implicit_sgd.h"
 #include "sgd/momentum_sgd.h"
 #include "sgd/nesterov_sgd.h"
@@ -20,7 +21,98 @@
 
 
 template<typename MODEL, typename SGD>
-Rcpp::List run(const data_set& data, MODEL& model, SGD& sgd);
+Rcpp::List run(const data_set& data, MODEL& model, SGD& sgd,
+  holdout_monitor<MODEL>* monitor = NULL);
+
+template<typename MODEL, typename SGD, typename CHECK>
+bool iterate(const data_set& data, MODEL& model, SGD& sgd, bool& converged,
+  CHECK check, checkpoint* ckpt = NULL,
+  holdout_monitor<MODEL>* monitor = NULL);
+
+template<typename MODEL, typename SGD, typename CHECK>
+bool iterate(const data_set& data, MODEL& model, SGD& sgd, vec& theta,
+  vec& theta_ave, bool& converged, CHECK check, checkpoint* ckpt = NULL,
+  holdout_monitor<MODEL>* monitor = NULL);
+
+template<typename MODEL>
+Rcpp::List run_holdout(const data_set& data, const Rcpp::List& model_control,
+  const Rcpp::List& sgd_control);
+
+template<typename MODEL, typename SGD>
+Rcpp::List run_holdout(const data_set& data, const Rcpp::List& model_control,
+  const Rcpp::List& sgd_control);
+
+template<typename MODEL>
+Rcpp::List run_hogwild(const data_set& data, MODEL& model, explicit_sgd& sgd);
+
+template<typename MODEL>
+Rcpp::List run_chains(const data_set& data, const Rcpp::List& model_control,
+  const Rcpp::List& chain_controls);
+
+template<typename MODEL, typename SGD>
+Rcpp::List run_chains(const data_set& data, const Rcpp::List& model_control,
+  const Rcpp::List& chain_controls);
+
+template<typename MODEL>
+Rcpp::List run_tuning(const data_set& data, const Rcpp::List& model_control,
+  const Rcpp::List& tune);
+
+template<typename MODEL, typename SGD>
+Rcpp::List run_tuning(const data_set& data, const Rcpp::List& model_control,
+  const Rcpp::List& tune);
+
+/**
+ * Constructs the data set to run on. An in-memory design matrix is viewed in
+ * R's memory rather than copied.
+ *
+ * @param Dataset     data set as R type
+ * @param Sgd_control attributes affiliated with sgd
+ */
+data_set* new_data_set(Rcpp::List Dataset, Rcpp::List Sgd_control) {
+  bool big = Rcpp::as<bool>(Dataset["big"]);
+  bool sparse = Rcpp::as<bool>(Dataset["sparse"]);
+  bool stream = Rcpp::as<bool>(Dataset["stream"]);
+  bool mapped = Rcpp::as<bool>(Dataset["mapped"]);
+  Rcpp::NumericMatrix Xr = (big || sparse || stream || mapped) ?
+    Rcpp::NumericMatrix(0, 0) : Rcpp::NumericMatrix(Dataset["X"]);
+  mat X(Xr.begin(), Xr.nrow(), Xr.ncol(), false, true);
+  if (mapped) {
+    Rcpp::List Source(Dataset["X"]);
+    return new data_set(
+      new data_file(Rcpp::as<std::string>(Source["file"])),
+      Rcpp::as<unsigned>(Sgd_control["npasses"]),
+      Rcpp::as<std::string>(Sgd_control["shuffle"]),
+      Rcpp::as<unsigned>(Sgd_control["seed"]),
+      Rcpp::as<vec>(Sgd_control["shuffle.control"]));
+  } else if (stream) {
+    Rcpp::List Source(Dataset["X"]);
+    return new data_set(
+      new stream_reader(Rcpp::as<std::string>(Source["file"]),
+                        Rcpp::as<std::string>(Source["format"]),
+                        Rcpp::as<unsigned>(Source["ncol"]),
+                        Rcpp::as<unsigned>(Source["y.col"]) - 1,
+                        Rcpp::as<unsigned>(Source["chunk.size"]),
+                        Rcpp::as<bool>(Source["header"]),
+                        Rcpp::as<bool>(Source["pipe"])),
+      Rcpp::as<unsigned>(Sgd_control["npasses"]));
+  } else {
+    return new data_set(Dataset["bigmat"],
+                        Dataset["ybigmat"],
+                        Rcpp::as<unsigned>(Dataset["y.col"]),
+                        X,
+                        sparse ? Rcpp::as<sp_mat>(Dataset["X"]) : sp_mat(),
+                        Rcpp::as<mat>(Dataset["Y"]),
+                        Rcpp::as<unsigned>(Sgd_control["npasses"]),
+                        big,
+                        sparse,
+                        Rcpp::as<std::string>(Sgd_control["shuffle"]),
+                        Rcpp::as<unsigned>(Sgd_control["seed"]),
+                        Rcpp::as<vec>(Sgd_control["shuffle.control"]),
+                        Rcpp::as<std::string>(Sgd_control["layout"]) == "row",
+                        Rcpp::as<std::string>(Sgd_control["precision"]) ==
+                          "single");
+  }
+}
 
 /**
  * Runs the proposed model and stochastic gradient method on the data set
@@ -39,12 +131,50 @@ Rcpp::List run(SEXP dataset, SEXP model_control, SEXP sgd_control) {
   }
 
   // Construct data.
-  data_set data(Dataset["bigmat"],
-                Rcpp::as<mat>(Dataset["X"]),
-                Rcpp::as<mat>(Dataset["Y"]),
-                Rcpp::as<unsigned>(Sgd_control["npasses"]),
-                Rcpp::as<bool>(Dataset["big"]),
-                Rcpp::as<bool>(Sgd_control["shuffle"]));
+  std::unique_ptr<data_set> data_ptr(new_data_set(Dataset, Sgd_control));
+  const data_set& data = *data_ptr;
+
+  // Independent chains on threads of their own, each with its own list of
+  // attributes affiliated with sgd.
+  if (Sgd_control.containsElementNamed("chains")) {
+    std::string model_name = Rcpp::as<std::string>(Model_control["name"]);
+    Rcpp::List Chains(Sgd_control["chains"]);
+    if (model_name == "lm" || model_name == "glm") {
+      return run_chains<glm_model>(data, Model_control, Chains);
+    } else if (model_name == "m") {
+      return run_chains<m_model>(data, Model_control, Chains);
+    } else {
+      Rcpp::Rcout << "error: chains not implemented for model yet" << std::endl;
+      return Rcpp::List();
+    }
+  }
+
+  // Learning rates tuned on a subsample before running on all data.
+  if (Sgd_control.containsElementNamed("tune")) {
+    std::string model_name = Rcpp::as<std::string>(Model_control["name"]);
+    Rcpp::List Tune(Sgd_control["tune"]);
+    if (model_name == "lm" || model_name == "glm") {
+      return run_tuning<glm_model>(data, Model_control, Tune);
+    } else if (model_name == "m") {
+      return run_tuning<m_model>(data, Model_control, Tune);
+    } else {
+      Rcpp::Rcout << "error: tuning not implemented for model yet" << std::endl;
+      return Rcpp::List();
+    }
+  }
+
+  // Convergence decided by the loss on held-out data points.
+  if (Rcpp::as<unsigned>(Sgd_control["holdout"]) > 0) {
+    std::string model_name = Rcpp::as<std::string>(Model_control["name"]);
+    if (model_name == "lm" || model_name == "glm") {
+      return run_holdout<glm_model>(data, Model_control, Sgd_control);
+    } else if (model_name == "m") {
+      return run_holdout<m_model>(data, Model_control, Sgd_control);
+    } else {
+      Rcpp::Rcout << "error: holdout not implemented for model yet" << std::endl;
+      return Rcpp::List();
+    }
+  }
 
   // Construct model.
   std::string model_name = Rcpp::as<std::string>(Model_control["name"]);
@@ -74,6 +204,9 @@ Rcpp::List run(SEXP dataset, SEXP model_control, SEXP sgd_control) {
     std::string sgd_name = Rcpp::as<std::string>(Sgd_control["method"]);
     if (sgd_name == "sgd" || sgd_name == "asgd") {
       explicit_sgd sgd(Sgd_control, data.n_samples);
+      if (sgd.n_threads() > 1 && sgd.batch_size() == 1) {
+        return run_hogwild(data, model, sgd);
+      }
       return run(data, model, sgd);
     } else if (sgd_name == "implicit" || sgd_name == "ai-sgd") {
       implicit_sgd sgd(Sgd_control, data.n_samples);
@@ -114,6 +247,9 @@ Rcpp::List run(SEXP dataset, SEXP model_control, SEXP sgd_control) {
     std::string sgd_name = Rcpp::as<std::string>(Sgd_control["method"]);
     if (sgd_name == "sgd" || sgd_name == "asgd") {
       explicit_sgd sgd(Sgd_control, data.n_samples);
+      if (sgd.n_threads() > 1 && sgd.batch_size() == 1) {
+        return run_hogwild(data, model, sgd);
+      }
       return run(data, model, sgd);
     } else if (sgd_name == "implicit" || sgd_name == "ai-sgd") {
       implicit_sgd sgd(Sgd_control, data.n_samples);
@@ -156,6 +292,70 @@ Rcpp::List run(SEXP dataset, SEXP model_control, SEXP sgd_control) {
   #endif
 }
 
+/**
+ * Writes a design matrix and responses to a data file
+ *
+ * @param X         design matrix
+ * @param Y         response values
+ * @param file      path of the file to write
+ * @param row_major whether to store X row by row
+ * @param single    whether to store X in single precision
+ */
+// [[Rcpp::export]]
+void write_data(const arma::mat& X, const arma::mat& Y, std::string file,
+  bool row_major, bool single) {
+  if (single) {
+    write_data_file<float>(X, Y, file, row_major);
+  } else {
+    write_data_file<double>(X, Y, file, row_major);
+  }
+}
+
+/**
+ * Number of heap allocations made by Armadillo so far, or -1 unless this is a
+ * test build that counts them
+ */
+// [[Rcpp::export]]
+double alloc_count() {
+  #ifdef SGD_COUNT_ALLOCS
+  return static_cast<double>(arma_alloc_count().load());
+  #else
+  return -1;
+  #endif
+}
+
+/**
+ * Reads the dimensions, layout and precision of a data file
+ *
+ * @param file path of the file
+ */
+// [[Rcpp::export]]
+Rcpp::List read_data_header(std::string file) {
+  data_file df(file);
+  const data_file_header& header = df.header();
+  return Rcpp::List::create(
+    Rcpp::Named("n") = static_cast<double>(header.n_samples),
+    Rcpp::Named("d") = static_cast<double>(header.n_features),
+    Rcpp::Named("layout") = header.layout ? "row" : "column",
+    Rcpp::Named("precision") = header.dtype ? "single" : "double");
+}
+
+/**
+ * Reads the method, iteration and seed of a checkpoint
+ *
+ * @param file path of the checkpoint
+ */
+// [[Rcpp::export]]
+Rcpp::List checkpoint_info(std::string file) {
+  std::string name;
+  unsigned t, seed;
+  checkpoint::info(file, name, t, seed);
+  return Rcpp::List::create(
+    Rcpp::Named("method") = name,
+    Rcpp::Named("t") = static_cast<double>(t),
+    Rcpp::Named("seed") = static_cast<double>(seed));
+}
+
 /**
  * Runs algorithm templated on the model and stochastic gradient method
  *
@@ -164,33 +364,181 @@ Rcpp::List run(SEXP dataset, SEXP model_control, SEXP sgd_control) {
  * @tparam SGD      stochastic gradient descent class
  */
 template<typename MODEL, typename SGD>
-Rcpp::List run(const data_set& data, MODEL& model, SGD& sgd) {
+Rcpp::List run(const data_set& data, MODEL& model, SGD& sgd,
+  holdout_monitor<MODEL>* monitor) {
+  if (sgd.verbose()) {
+    Rcpp::Rcout << "Stochastic gradient method: " << sgd.name() << std::endl;
+    Rcpp::Rcout << "SGD Start!" << std::endl;
+  }
+  bool converged = false;
+  bool valid = iterate(data, model, sgd, converged,
+    [&](const mat& theta, bool good_gradient, unsigned t) {
+      return validity_check(data, theta, good_gradient, t, model);
+    }, sgd.get_checkpoint(), monitor);
+  if (!valid) {
+    return Rcpp::List();
+  }
+
+  Rcpp::List model_out = post_process(sgd, data, model);
+
+  return Rcpp::List::create(
+    Rcpp::Named("model") = model.name(),
+    Rcpp::Named("coefficients") = sgd.get_last_estimate(),
+    Rcpp::Named("converged") = converged,
+    Rcpp::Named("estimates") = sgd.get_estimates(),
+    Rcpp::Named("pos") = sgd.get_pos(),
+    Rcpp::Named("model.out") = model_out);
+}
+
+// Sparse steps that update the estimate in place, for explicit SGD of the
+// models whose gradient is a multiple of the data point only; see
+// explicit_sgd::update_in_place.
+template<typename MODEL, typename SGD>
+bool sparse_steps(const data_set& data, const MODEL& model, const SGD& sgd) {
+  return false;
+}
+
+inline bool sparse_steps(const data_set& data, const glm_model& model,
+  const explicit_sgd& sgd) {
+  return sgd.sparse_steps(data, model);
+}
+
+inline bool sparse_steps(const data_set& data, const m_model& model,
+  const explicit_sgd& sgd) {
+  return sgd.sparse_steps(data, model);
+}
+
+template<typename MODEL, typename SGD>
+void update_in_place(unsigned t, const data_set& data, const MODEL& model,
+  SGD& sgd, mat& theta, bool& good_gradient) {
+}
+
+inline void update_in_place(unsigned t, const data_set& data,
+  const glm_model& model, explicit_sgd& sgd, mat& theta,
+  bool& good_gradient) {
+  sgd.update_in_place(t, data, model, theta, good_gradient);
+}
+
+inline void update_in_place(unsigned t, const data_set& data,
+  const m_model& model, explicit_sgd& sgd, mat& theta, bool& good_gradient) {
+  sgd.update_in_place(t, data, model, theta, good_gradient);
+}
+
+/**
+ * Iterates the stochastic gradient method over the data set until it
+ * converges or runs out of data, recording the estimates in sgd
+ *
+ * @param  converged set to whether the estimates converged
+ * @param  check     called as check(theta, good_gradient, t) after each
+ *                   iteration, or, if sparse steps update the estimate in
+ *                   place, after every 256th, any that checks convergence,
+ *                   the last, and any with a non-finite gradient; iterations
+ *                   stop once it returns false
+ * @param  ckpt      checkpoints to resume from and save to, or NULL; only on
+ *                   the main thread
+ * @param  monitor   loss on held-out data that decides convergence instead of
+ *                   the relative change of the estimates, or NULL
+ * @return false if check did, else true
+ * @tparam MODEL     model class
+ * @tparam SGD       stochastic gradient descent class
+ */
+template<typename MODEL, typename SGD, typename CHECK>
+bool iterate(const data_set& data, MODEL& model, SGD& sgd, bool& converged,
+  CHECK check, checkpoint* ckpt, holdout_monitor<MODEL>* monitor) {
+  vec theta = sgd.get_last_estimate();
+  vec theta_ave = theta;
+  if (ckpt && ckpt->resume()) {
+    ckpt->load(sgd, theta, theta_ave);
+  }
+  return iterate(data, model, sgd, theta, theta_ave, converged, check, ckpt,
+    monitor);
+}
+
+/**
+ * Iterates as above, continuing from the iteration after the last one of sgd
+ *
+ * @param  theta     estimate after the last iteration, updated in place
+ * @param  theta_ave its average if the method averages, updated in place
+ */
+template<typename MODEL, typename SGD, typename CHECK>
+bool iterate(const data_set& data, MODEL& model, SGD& sgd, vec& theta,
+  vec& theta_ave, bool& converged, CHECK check, checkpoint* ckpt,
+  holdout_monitor<MODEL>* monitor) {
   unsigned n_samples = data.n_samples;
   // unsigned n_features = data.n_features;
   unsigned n_passes = sgd.get_n_passes();
+  unsigned batch_size = sgd.batch_size();
+  unsigned every = sgd.convergence_every();
 
   bool good_gradient = true;
-  bool good_validity = true;
   bool averaging = false;
   if (sgd.name() == "asgd" || sgd.name() == "ai-sgd") {
     averaging = true;
   }
 
-  // TODO these should really be vec's
-  mat theta_new;
-  mat theta_new_ave;
-  mat theta_old = sgd.get_last_estimate();
-  mat theta_old_ave = theta_old;
+  // The estimates are updated in place, and the new and old buffers are
+  // swapped rather than copied, so that iterations make no heap allocations.
+  vec& theta_old = theta;
+  vec theta_new = theta_old;
+  vec& theta_old_ave = theta_ave;
+  vec theta_new_ave = theta_old_ave;
+  unsigned t_first = sgd.iteration() + 1;
 
-  unsigned max_iters = n_samples*n_passes;
+  // Number of the last iteration, or 0 if the data are streamed and their
+  // number is not known in advance. Each iteration takes a batch of data
+  // points, and the data set may follow data points of earlier iterations.
+  unsigned n_points = n_samples*n_passes;
+  unsigned max_iters = (n_points == 0) ? 0 :
+    (data.first() + n_points + batch_size - 1) / batch_size;
   bool do_more_iterations = true;
-  bool converged = false;
-  if (sgd.verbose()) {
-    Rcpp::Rcout << "Stochastic gradient method: " << sgd.name() << std::endl;
-    Rcpp::Rcout << "SGD Start!" << std::endl;
+  converged = false;
+  if (sparse_steps(data, model, sgd)) {
+    // Each step touches only the nonzero covariates of its data point. The
+    // estimate is copied, checked and published only every 256 iterations,
+    // when the checkpoint and asynchronous fits read it, and when convergence
+    // is checked against it.
+    for (unsigned t = t_first; do_more_iterations &&
+         data.has_data_point(t); ++t) {
+      bool check_now = t % every == 0 &&
+        (monitor || sgd.checks_estimates());
+      bool dense = check_now || t % 256 == 0 || t == max_iters;
+      if (check_now && !monitor) {
+        theta_new = theta_old;
+      }
+      update_in_place(t, data, model, sgd, theta_old, good_gradient);
+      sgd.advance(theta_old, dense);
+      if ((dense || !good_gradient) && !check(theta_old, good_gradient, t)) {
+        return false;
+      }
+      if (!check_now) {
+        converged = false;
+      } else if (monitor) {
+        converged = monitor->update(t, theta_old) && !sgd.pass();
+      } else {
+        converged = sgd.check_convergence(theta_old, theta_new);
+      }
+      if (converged) {
+        sgd.end_early();
+        do_more_iterations = false;
+      }
+      if (t == max_iters) {
+        do_more_iterations = false;
+      }
+      if (ckpt && do_more_iterations) {
+        ckpt->update(t, sgd, theta_old, theta_old_ave);
+      }
+    }
+    if (!converged) {
+      sgd.set_last_estimate(theta_old);
+    }
+    if (max_iters == 0 && !converged) {
+      sgd.end_early();
+    }
+    return true;
   }
-  for (unsigned t = 1; do_more_iterations; ++t) {
-    theta_new = sgd.update(t, theta_old, data, model, good_gradient);
+  for (unsigned t = t_first; do_more_iterations &&
+       data.has_data_point(sgd.batch_start(t)); ++t) {
+    sgd.update(t, theta_old, data, model, theta_new, good_gradient);
 
     if (averaging) {
       if (t != 1) {
@@ -204,13 +552,19 @@ Rcpp::List run(const data_set& data, MODEL& model, SGD& sgd) {
       sgd = theta_new;
     }
 
-    good_validity = validity_check(data, theta_new, good_gradient, t, model);
-    if (!good_validity) {
-      return Rcpp::List();
+    if (!check(theta_new, good_gradient, t)) {
+      return false;
     }
 
-    // Check if satisfy convergence threshold.
-    if (averaging) {
+    // Check if satisfy convergence threshold, every few iterations. The loss
+    // on held-out data, if monitored, is evaluated regardless, but only stops
+    // the iterations if they need not run for all passes.
+    if (t % every != 0) {
+      converged = false;
+    } else if (monitor) {
+      converged = monitor->update(t, averaging ? theta_new_ave : theta_new) &&
+        !sgd.pass();
+    } else if (averaging) {
       converged = sgd.check_convergence(theta_new_ave, theta_old_ave);
     } else {
       converged = sgd.check_convergence(theta_new, theta_old);
@@ -235,18 +589,739 @@ Rcpp::List run(const data_set& data, MODEL& model, SGD& sgd) {
 
     // Set old to new updates and repeat.
     if (averaging) {
-      theta_old_ave = theta_new_ave;
+      theta_old_ave.swap(theta_new_ave);
+    }
+    theta_old.swap(theta_new);
+    if (ckpt && do_more_iterations) {
+      ckpt->update(t, sgd, theta_old, theta_old_ave);
     }
-    theta_old = theta_new;
   }
+  if (max_iters == 0 && !converged) {
+    sgd.end_early();
+  }
+  return true;
+}
+
+/**
+ * Runs explicit SGD on several threads updating a shared estimate without
+ * locks, for all iterations
+ *
+ * @param  data     data set, which must not be read through a stateful reader
+ * @tparam MODEL    model class
+ */
+template<typename MODEL>
+Rcpp::List run_hogwild(const data_set& data, MODEL& model, explicit_sgd& sgd) {
+  if (sgd.verbose()) {
+    Rcpp::Rcout << "Stochastic gradient method: " << sgd.name() << " on "
+      << sgd.n_threads() << " threads" << std::endl;
+    Rcpp::Rcout << "SGD Start!" << std::endl;
+  }
+  bool good_gradient = true;
+  sgd.run_hogwild(data, model, good_gradient);
+  if (!validity_check(data, sgd.get_last_estimate(), good_gradient,
+                      data.n_samples*sgd.get_n_passes(), model)) {
+    return Rcpp::List();
+  }
+  sgd.end_early();
 
   Rcpp::List model_out = post_process(sgd, data, model);
 
   return Rcpp::List::create(
     Rcpp::Named("model") = model.name(),
     Rcpp::Named("coefficients") = sgd.get_last_estimate(),
-    Rcpp::Named("converged") = converged,
+    Rcpp::Named("converged") = false,
     Rcpp::Named("estimates") = sgd.get_estimates(),
     Rcpp::Named("pos") = sgd.get_pos(),
     Rcpp::Named("model.out") = model_out);
 }
+
+/**
+ * Runs chains of the stochastic gradient method with the model class, each
+ * chain with the method named in its attributes
+ *
+ * @param  data           data set
+ * @param  model_control  attributes affiliated with model
+ * @param  chain_controls attributes affiliated with sgd, one list per chain
+ * @tparam MODEL          model class
+ */
+template<typename MODEL>
+Rcpp::List run_chains(const data_set& data, const Rcpp::List& model_control,
+  const Rcpp::List& chain_controls) {
+  Rcpp::List first(chain_controls[0]);
+  std::string sgd_name = Rcpp::as<std::string>(first["method"]);
+  if (sgd_name == "sgd" || sgd_name == "asgd") {
+    return run_chains<MODEL, explicit_sgd>(data, model_control,
+      chain_controls);
+  } else if (sgd_name == "implicit" || sgd_name == "ai-sgd") {
+    return run_chains<MODEL, implicit_sgd>(data, model_control,
+      chain_controls);
+  } else if (sgd_name == "momentum") {
+    return run_chains<MODEL, momentum_sgd>(data, model_control,
+      chain_controls);
+  } else if (sgd_name == "nesterov") {
+    return run_chains<MODEL, nesterov_sgd>(data, model_control,
+      chain_controls);
+  } else {
+    Rcpp::Rcout << "error: stochastic gradient method not implemented" << std::endl;
+    return Rcpp::List();
+  }
+}
+
+/**
+ * Runs independent chains of the stochastic gradient method against the same
+ * data set, one thread per chain, and mixes their estimates by averaging.
+ * Each chain visits the data points in the order of its own seed and has its
+ * own model and method objects, so chains share nothing but the read-only
+ * data; everything that calls into R is done before and after they run.
+ *
+ * @param  data           data set, which must not be read through a stateful
+ *                        reader
+ * @param  model_control  attributes affiliated with model
+ * @param  chain_controls attributes affiliated with sgd, one list per chain
+ * @tparam MODEL          model class
+ * @tparam SGD            stochastic gradient descent class
+ */
+template<typename MODEL, typename SGD>
+Rcpp::List run_chains(const data_set& data, const Rcpp::List& model_control,
+  const Rcpp::List& chain_controls) {
+  unsigned n_chains = chain_controls.size();
+  std::vector<std::unique_ptr<data_set> > orders;
+  std::vector<std::unique_ptr<MODEL> > models;
+  std::vector<std::unique_ptr<SGD> > sgds;
+  for (unsigned k = 0; k < n_chains; ++k) {
+    Rcpp::List control(chain_controls[k]);
+    orders.emplace_back(new data_set(data, Rcpp::as<unsigned>(control["seed"]),
+      Rcpp::as<vec>(control["shuffle.control"])));
+    models.emplace_back(new MODEL(model_control));
+    sgds.emplace_back(new SGD(control, data.n_samples));
+  }
+  if (sgds[0]->verbose()) {
+    Rcpp::Rcout << "Stochastic gradient method: " << sgds[0]->name() << ", "
+      << n_chains << " chains" << std::endl;
+    Rcpp::Rcout << "SGD Start!" << std::endl;
+  }
+
+  // A chain stops at its first non-finite gradient, which is reported once
+  // all are done.
+  std::vector<int> converged(n_chains, 0);
+  std::vector<int> good(n_chains, 1);
+  thread_pool pool(n_chains);
+  pool.run(n_chains, [&](unsigned k) {
+    bool chain_converged = false;
+    good[k] = iterate(*orders[k], *models[k], *sgds[k], chain_converged,
+      [](const mat&, bool good_gradient, unsigned) {
+        return good_gradient;
+      });
+    converged[k] = chain_converged;
+  });
+
+  // The mixed estimates are the means over chains of the last estimates, and
+  // of the estimates recorded at the same iterations by all chains.
+  mat coef = zeros<mat>(sgds[0]->get_last_estimate().n_rows, 1);
+  Mat<unsigned> pos = sgds[0]->get_pos();
+  unsigned n_common = pos.n_cols;
+  Rcpp::List chains(n_chains);
+  for (unsigned k = 0; k < n_chains; ++k) {
+    if (!validity_check(*orders[k], sgds[k]->get_last_estimate(),
+                        good[k] != 0, data.n_samples*sgds[k]->get_n_passes(),
+                        *models[k])) {
+      return Rcpp::List();
+    }
+    coef += sgds[k]->get_last_estimate();
+    Mat<unsigned> pos_k = sgds[k]->get_pos();
+    unsigned j = 0;
+    while (j < n_common && j < pos_k.n_cols && pos_k(0, j) == pos(0, j)) {
+      ++j;
+    }
+    n_common = j;
+    chains[k] = Rcpp::List::create(
+      Rcpp::Named("coefficients") = sgds[k]->get_last_estimate(),
+      Rcpp::Named("converged") = converged[k] != 0,
+      Rcpp::Named("estimates") = sgds[k]->get_estimates(),
+      Rcpp::Named("pos") = pos_k);
+  }
+  coef /= n_chains;
+  mat estimates = zeros<mat>(coef.n_rows, n_common);
+  for (unsigned k = 0; k < n_chains; ++k) {
+    estimates += sgds[k]->get_estimates().head_cols(n_common);
+  }
+  estimates /= n_chains;
+  pos = pos.head_cols(n_common);
+
+  Rcpp::List model_out = post_process(*sgds[0], data, *models[0]);
+
+  return Rcpp::List::create(
+    Rcpp::Named("model") = models[0]->name(),
+    Rcpp::Named("coefficients") = coef,
+    Rcpp::Named("converged") = std::find(converged.begin(), converged.end(),
+                                         0) == converged.end(),
+    Rcpp::Named("estimates") = estimates,
+    Rcpp::Named("pos") = pos,
+    Rcpp::Named("model.out") = model_out,
+    Rcpp::Named("chains") = chains);
+}
+
+/**
+ * Tunes the learning rate for the model class, with the method named in the
+ * attributes of the candidates
+ *
+ * @param  data          data set
+ * @param  model_control attributes affiliated with model
+ * @param  tune          candidates and schedule of the search
+ * @tparam MODEL         model class
+ */
+template<typename MODEL>
+Rcpp::List run_tuning(const data_set& data, const Rcpp::List& model_control,
+  const Rcpp::List& tune) {
+  Rcpp::List candidates(tune["candidates"]);
+  Rcpp::List first(candidates[0]);
+  std::string sgd_name = Rcpp::as<std::string>(first["method"]);
+  if (sgd_name == "sgd" || sgd_name == "asgd") {
+    return run_tuning<MODEL, explicit_sgd>(data, model_control, tune);
+  } else if (sgd_name == "implicit" || sgd_name == "ai-sgd") {
+    return run_tuning<MODEL, implicit_sgd>(data, model_control, tune);
+  } else if (sgd_name == "momentum") {
+    return run_tuning<MODEL, momentum_sgd>(data, model_control, tune);
+  } else if (sgd_name == "nesterov") {
+    return run_tuning<MODEL, nesterov_sgd>(data, model_control, tune);
+  } else {
+    Rcpp::Rcout << "error: stochastic gradient method not implemented" << std::endl;
+    return Rcpp::List();
+  }
+}
+
+/**
+ * Chooses among candidate learning rates on a subsample of the data set, and
+ * runs the best of them on all of it. The subsample is split into data points
+ * trained on and data points held out. In each round, the remaining
+ * candidates are trained in parallel, one thread each, and scored by their
+ * mean loss on the held-out data points. A grid search keeps the best after
+ * one round; successive halving keeps the better half and doubles the number
+ * of passes, until one is left. All rounds share the storage of the data set.
+ *
+ * @param  data          data set, which must not be read through a stateful
+ *                       reader
+ * @param  model_control attributes affiliated with model
+ * @param  tune          list of the candidates' attributes affiliated with
+ *                       sgd, the sizes of the training and held-out parts of
+ *                       the subsample, its seed, the schedule ("grid" or
+ *                       "halving") and the number of passes of the first
+ *                       round
+ * @tparam MODEL         model class
+ * @tparam SGD           stochastic gradient descent class
+ */
+template<typename MODEL, typename SGD>
+Rcpp::List run_tuning(const data_set& data, const Rcpp::List& model_control,
+  const Rcpp::List& tune) {
+  Rcpp::List candidates(tune["candidates"]);
+  unsigned n_candidates = candidates.size();
+  unsigned n_train = Rcpp::as<unsigned>(tune["n.train"]);
+  unsigned n_holdout = Rcpp::as<unsigned>(tune["n.holdout"]);
+  unsigned n_passes = Rcpp::as<unsigned>(tune["npasses"]);
+  bool halving = Rcpp::as<std::string>(tune["schedule"]) == "halving";
+  Rcpp::List first(candidates[0]);
+  unsigned seed = Rcpp::as<unsigned>(first["seed"]);
+  vec shuffle_control = Rcpp::as<vec>(first["shuffle.control"]);
+  bool verbose = Rcpp::as<bool>(first["verbose"]);
+
+  permutation subset(data.n_samples, Rcpp::as<unsigned>(tune["seed"]));
+  data_set holdout(data, &subset, n_train, n_holdout, 1, seed,
+    shuffle_control);
+
+  unsigned n_rounds = 0;
+  for (unsigned m = n_candidates; m > 1; m = halving ? (m + 1) / 2 : 1) {
+    ++n_rounds;
+  }
+  mat scores(n_candidates, n_rounds);
+  scores.fill(NA_REAL);
+  std::vector<unsigned> alive(n_candidates);
+  for (unsigned k = 0; k < n_candidates; ++k) {
+    alive[k] = k;
+  }
+  unsigned n_threads = std::max(1u, std::thread::hardware_concurrency());
+
+  for (unsigned round = 0; alive.size() > 1; ++round) {
+    unsigned n_alive = alive.size();
+    if (verbose) {
+      Rcpp::Rcout << "Tuning round " << round + 1 << ": " << n_alive
+        << " candidates, " << n_passes << " passes over " << n_train
+        << " data points" << std::endl;
+    }
+    // Everything touching R is done here, on the calling thread.
+    std::vector<std::unique_ptr<data_set> > trains;
+    std::vector<std::unique_ptr<MODEL> > models;
+    std::vector<std::unique_ptr<SGD> > sgds;
+    for (unsigned i = 0; i < n_alive; ++i) {
+      Rcpp::List control = Rcpp::clone(Rcpp::List(candidates[alive[i]]));
+      control["npasses"] = n_passes;
+      control["nthreads"] = 1;
+      trains.emplace_back(new data_set(data, &subset, 0, n_train, n_passes,
+        seed, shuffle_control));
+      models.emplace_back(new MODEL(model_control));
+      sgds.emplace_back(new SGD(control, n_train));
+    }
+
+    // A candidate whose gradients or loss are not finite scores infinity.
+    vec round_scores(n_alive);
+    thread_pool pool(std::min(n_alive, n_threads));
+    pool.run(n_alive, [&](unsigned i) {
+      bool converged = false;
+      bool good = iterate(*trains[i], *models[i], *sgds[i], converged,
+        [](const mat&, bool good_gradient, unsigned) {
+          return good_gradient;
+        });
+      double score = mean_loss(holdout, *models[i],
+        sgds[i]->get_last_estimate());
+      round_scores(i) = (good && std::isfinite(score)) ? score : datum::inf;
+    });
+
+    std::vector<unsigned> order(n_alive);
+    for (unsigned i = 0; i < n_alive; ++i) {
+      order[i] = i;
+      scores(alive[i], round) = round_scores(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+      return round_scores(a) < round_scores(b);
+    });
+    std::vector<unsigned> kept(halving ? (n_alive + 1) / 2 : 1);
+    for (unsigned i = 0; i < kept.size(); ++i) {
+      kept[i] = alive[order[i]];
+    }
+    alive.swap(kept);
+    n_passes *= 2;
+  }
+
+  unsigned best = alive[0];
+  MODEL model(model_control);
+  SGD sgd(Rcpp::List(candidates[best]), data.n_samples);
+  Rcpp::List out = run(data, model, sgd);
+  if (out.size() > 0) {
+    out.push_back(Rcpp::List::create(
+      Rcpp::Named("scores") = scores,
+      Rcpp::Named("best") = best + 1), "tune");
+  }
+  return out;
+}
+
+/**
+ * Runs the method named in the attributes with the model class, with
+ * convergence decided by the loss on held-out data points
+ *
+ * @param  data          data set
+ * @param  model_control attributes affiliated with model
+ * @param  sgd_control   attributes affiliated with sgd
+ * @tparam MODEL         model class
+ */
+template<typename MODEL>
+Rcpp::List run_holdout(const data_set& data, const Rcpp::List& model_control,
+  const Rcpp::List& sgd_control) {
+  std::string sgd_name = Rcpp::as<std::string>(sgd_control["method"]);
+  if (sgd_name == "sgd" || sgd_name == "asgd") {
+    return run_holdout<MODEL, explicit_sgd>(data, model_control, sgd_control);
+  } else if (sgd_name == "implicit" || sgd_name == "ai-sgd") {
+    return run_holdout<MODEL, implicit_sgd>(data, model_control, sgd_control);
+  } else if (sgd_name == "momentum") {
+    return run_holdout<MODEL, momentum_sgd>(data, model_control, sgd_control);
+  } else if (sgd_name == "nesterov") {
+    return run_holdout<MODEL, nesterov_sgd>(data, model_control, sgd_control);
+  } else {
+    Rcpp::Rcout << "error: stochastic gradient method not implemented" << std::endl;
+    return Rcpp::List();
+  }
+}
+
+/**
+ * Runs on a random part of the data set, holding the rest out, and stops once
+ * the loss on the held-out data points has not improved by a relative reltol
+ * for patience checks in a row; see holdout_monitor. Both parts share the
+ * storage of the data set.
+ *
+ * @param  data          data set, which must not be read through a stateful
+ *                       reader
+ * @param  model_control attributes affiliated with model
+ * @param  sgd_control   attributes affiliated with sgd, including the number
+ *                       of data points held out and the patience
+ * @tparam MODEL         model class
+ * @tparam SGD           stochastic gradient descent class
+ */
+template<typename MODEL, typename SGD>
+Rcpp::List run_holdout(const data_set& data, const Rcpp::List& model_control,
+  const Rcpp::List& sgd_control) {
+  unsigned n_holdout = Rcpp::as<unsigned>(sgd_control["holdout"]);
+  unsigned n_train = data.n_samples - n_holdout;
+  unsigned seed = Rcpp::as<unsigned>(sgd_control["seed"]);
+  vec shuffle_control = Rcpp::as<vec>(sgd_control["shuffle.control"]);
+
+  permutation subset(data.n_samples, seed);
+  data_set train(data, &subset, 0, n_train,
+    Rcpp::as<unsigned>(sgd_control["npasses"]), seed, shuffle_control);
+  data_set holdout(data, &subset, n_train, n_holdout, 1, seed,
+    shuffle_control);
+  MODEL model(model_control);
+  SGD sgd(sgd_control, n_train);
+  holdout_monitor<MODEL> monitor(holdout, model, sgd.reltol(),
+    Rcpp::as<unsigned>(sgd_control["patience"]));
+  Rcpp::List out = run(train, model, sgd, &monitor);
+  monitor.finish();
+  if (out.size() > 0) {
+    out.push_back(Rcpp::List::create(
+      Rcpp::Named("loss") = monitor.losses(),
+      Rcpp::Named("pos") = monitor.iterations()), "holdout");
+  }
+  return out;
+}
+
+/**
+ * Model and stochastic gradient method kept alive between calls from R, so
+ * that a fit is updated online as new data arrive. Each partial fit continues
+ * the iterations of the earlier ones, with the state of the learning rate and
+ * of the averaging intact, rather than starting over from all the data.
+ */
+class base_online {
+public:
+  virtual ~base_online() {}
+
+  // Run on the data set, following the data of the earlier partial fits
+  virtual Rcpp::List partial_fit(data_set& data) = 0;
+};
+
+template<typename MODEL, typename SGD>
+class online_fit : public base_online {
+  /**
+   * @param model_control attributes affiliated with model
+   * @param sgd_control   attributes affiliated with sgd; as for a stream, the
+   *                      number of data points is not known in advance
+   */
+public:
+  online_fit(Rcpp::List model_control, Rcpp::List sgd_control) :
+    model_(model_control), sgd_(sgd_control, 0),
+    theta_(sgd_.get_last_estimate()), theta_ave_(theta_), failed_(false) {}
+
+  Rcpp::List partial_fit(data_set& data) {
+    if (failed_) {
+      Rcpp::stop("the online fit failed earlier and cannot be updated");
+    }
+    data.set_first(sgd_.batch_start(sgd_.iteration() + 1) - 1);
+    bool converged = false;
+    bool valid = iterate(data, model_, sgd_, theta_, theta_ave_, converged,
+      [&](const mat& theta, bool good_gradient, unsigned t) {
+        return validity_check(data, theta, good_gradient, t, model_);
+      });
+    if (!valid) {
+      failed_ = true;
+      return Rcpp::List();
+    }
+    return Rcpp::List::create(
+      Rcpp::Named("coefficients") = sgd_.get_last_estimate(),
+      Rcpp::Named("t") = static_cast<double>(sgd_.iteration()));
+  }
+
+private:
+  MODEL model_;
+  SGD sgd_;
+  vec theta_;     // estimate after the last iteration
+  vec theta_ave_; // its average, if the method averages
+  bool failed_;   // whether a partial fit failed, leaving the state invalid
+};
+
+template<typename MODEL>
+base_online* new_online_fit(Rcpp::List model_control,
+  Rcpp::List sgd_control) {
+  std::string sgd_name = Rcpp::as<std::string>(sgd_control["method"]);
+  if (sgd_name == "sgd" || sgd_name == "asgd") {
+    return new online_fit<MODEL, explicit_sgd>(model_control, sgd_control);
+  } else if (sgd_name == "implicit" || sgd_name == "ai-sgd") {
+    return new online_fit<MODEL, implicit_sgd>(model_control, sgd_control);
+  } else if (sgd_name == "momentum") {
+    return new online_fit<MODEL, momentum_sgd>(model_control, sgd_control);
+  } else if (sgd_name == "nesterov") {
+    return new online_fit<MODEL, nesterov_sgd>(model_control, sgd_control);
+  }
+  Rcpp::stop("stochastic gradient method not implemented");
+}
+
+/**
+ * Constructs a model and stochastic gradient method to be updated online
+ *
+ * @param model_control attributes affiliated with model
+ * @param sgd_control   attributes affiliated with sgd
+ */
+// [[Rcpp::export]]
+SEXP online_new(SEXP model_control, SEXP sgd_control) {
+  Rcpp::List Model_control(model_control);
+  Rcpp::List Sgd_control(sgd_control);
+  std::string model_name = Rcpp::as<std::string>(Model_control["name"]);
+  base_online* online;
+  if (model_name == "lm" || model_name == "glm") {
+    online = new_online_fit<glm_model>(Model_control, Sgd_control);
+  } else if (model_name == "m") {
+    online = new_online_fit<m_model>(Model_control, Sgd_control);
+  } else {
+    Rcpp::stop("online fits not implemented for model yet");
+  }
+  return Rcpp::XPtr<base_online>(online, true);
+}
+
+/**
+ * Updates a model constructed by online_new() on new data
+ *
+ * @param online      external pointer to the model
+ * @param dataset     data set
+ * @param sgd_control attributes affiliated with sgd
+ */
+// [[Rcpp::export]]
+Rcpp::List online_partial_fit(SEXP online, SEXP dataset, SEXP sgd_control) {
+  Rcpp::XPtr<base_online> Online(online);
+  if (!Online.get()) {
+    Rcpp::stop("the online fit is no longer valid, e.g., after being saved");
+  }
+  std::unique_ptr<data_set> data(new_data_set(Rcpp::List(dataset),
+    Rcpp::List(sgd_control)));
+  return Online->partial_fit(*data);
+}
+
+/**
+ * Fit running on a thread of its own, so that R goes on while it runs, and
+ * which can be polled for its progress and cancelled.
+ */
+class base_async {
+public:
+  virtual ~base_async() {}
+
+  // Progress of the fit so far
+  virtual Rcpp::List poll() = 0;
+
+  // Ask the fit to stop after its current iteration
+  virtual void cancel() = 0;
+
+  // Wait for the fit to end, and return its results as run() does
+  virtual Rcpp::List result() = 0;
+};
+
+template<typename MODEL, typename SGD>
+class async_fit : public base_async {
+  /**
+   * Everything that calls into R, i.e., constructing the data set, model and
+   * method and post-processing the results, is done on the calling thread;
+   * the thread of the fit only iterates. It publishes the estimate every
+   * publish_every iterations, together with a moving average of the loss of
+   * the model at the data point after each loss_every th iteration, before
+   * it is used (progressive validation).
+   *
+   * @param dataset       data set as R type, kept alive while the fit runs
+   *                      since the data set views its memory
+   * @param model_control attributes affiliated with model
+   * @param sgd_control   attributes affiliated with sgd
+   */
+public:
+  async_fit(Rcpp::List dataset, Rcpp::List model_control,
+    Rcpp::List sgd_control) :
+    dataset_(dataset), data_(new_data_set(dataset, sgd_control)),
+    model_(model_control), sgd_(sgd_control, data_->n_samples),
+    t_(0), cancel_(false), done_(false), valid_(false), converged_(false),
+    cancelled_(false), theta_(sgd_.get_last_estimate()), loss_(NA_REAL),
+    start_(std::chrono::steady_clock::now()), end_(start_) {
+    thread_ = std::thread([this]() { run_(); });
+  }
+
+  ~async_fit() {
+    cancel_ = true;
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  Rcpp::List poll() {
+    bool done = done_.load();
+    std::chrono::duration<double> elapsed =
+      (done ? end_ : std::chrono::steady_clock::now()) - start_;
+    unsigned t = t_.load();
+    std::lock_guard<std::mutex> lock(mutex_);
+    return Rcpp::List::create(
+      Rcpp::Named("t") = static_cast<double>(t),
+      Rcpp::Named("coefficients") = theta_,
+      Rcpp::Named("loss") = loss_,
+      Rcpp::Named("throughput") = static_cast<double>(t) *
+        sgd_.batch_size() / std::max(elapsed.count(), 1e-9),
+      Rcpp::Named("elapsed") = elapsed.count(),
+      Rcpp::Named("done") = done);
+  }
+
+  void cancel() {
+    cancel_ = true;
+  }
+
+  Rcpp::List result() {
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    if (!error_.empty()) {
+      Rcpp::stop(error_);
+    }
+    if (!valid_) {
+      return Rcpp::List();
+    }
+    Rcpp::List model_out = post_process(sgd_, *data_, model_);
+    return Rcpp::List::create(
+      Rcpp::Named("model") = model_.name(),
+      Rcpp::Named("coefficients") = sgd_.get_last_estimate(),
+      Rcpp::Named("converged") = converged_,
+      Rcpp::Named("cancelled") = cancelled_,
+      Rcpp::Named("estimates") = sgd_.get_estimates(),
+      Rcpp::Named("pos") = sgd_.get_pos(),
+      Rcpp::Named("model.out") = model_out);
+  }
+
+private:
+  static const unsigned publish_every = 256;
+  static const unsigned loss_every = 16;
+
+  // An error escaping the thread would terminate R, so it is kept and raised
+  // by result() on the calling thread instead.
+  void run_() {
+    try {
+      iterate_();
+    } catch (std::exception& e) {
+      error_ = e.what();
+    } catch (...) {
+      error_ = "unknown error in asynchronous fit";
+    }
+    end_ = std::chrono::steady_clock::now();
+    done_ = true;
+  }
+
+  void iterate_() {
+    double loss = NA_REAL;
+    bool converged = false;
+    bool valid = iterate(*data_, model_, sgd_, converged,
+      [&](const mat& theta, bool good_gradient, unsigned t) {
+        if (t % loss_every == 0) {
+          unsigned next = sgd_.batch_start(t + 1);
+          if (data_->has_data_point(next)) {
+            double l = model_.loss(data_->get_data_point(next), theta);
+            loss = R_IsNA(loss) ? l : 0.95 * loss + 0.05 * l;
+          }
+        }
+        if (t % publish_every == 0) {
+          publish_(loss);
+        }
+        t_.store(t, std::memory_order_relaxed);
+        return good_gradient && !cancel_.load(std::memory_order_relaxed);
+      });
+    cancelled_ = !valid && cancel_;
+    valid_ = valid || cancelled_;
+    converged_ = converged;
+    if (cancelled_) {
+      sgd_.end_early();
+    }
+    publish_(loss);
+  }
+
+  void publish_(double loss) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    theta_ = sgd_.get_last_estimate();
+    loss_ = loss;
+  }
+
+  Rcpp::List dataset_;
+  std::unique_ptr<data_set> data_;
+  MODEL model_;
+  SGD sgd_;
+  std::thread thread_;
+  std::atomic<unsigned> t_;        // iterations run
+  std::atomic<bool> cancel_;       // whether the fit was asked to stop
+  std::atomic<bool> done_;         // whether the fit has ended
+  bool valid_;                     // whether it ended with finite gradients
+  bool converged_;
+  bool cancelled_;                 // whether it ended by being cancelled
+  std::string error_;              // message of an error the fit ended with
+  std::mutex mutex_;               // guards the published state below
+  mat theta_;                      // estimate last published
+  double loss_;                    // moving average of the loss
+  std::chrono::steady_clock::time_point start_;
+  std::chrono::steady_clock::time_point end_;
+};
+
+template<typename MODEL>
+base_async* new_async_fit(Rcpp::List dataset, Rcpp::List model_control,
+  Rcpp::List sgd_control) {
+  std::string sgd_name = Rcpp::as<std::string>(sgd_control["method"]);
+  if (sgd_name == "sgd" || sgd_name == "asgd") {
+    return new async_fit<MODEL, explicit_sgd>(dataset, model_control,
+      sgd_control);
+  } else if (sgd_name == "implicit" || sgd_name == "ai-sgd") {
+    return new async_fit<MODEL, implicit_sgd>(dataset, model_control,
+      sgd_control);
+  } else if (sgd_name == "momentum") {
+    return new async_fit<MODEL, momentum_sgd>(dataset, model_control,
+      sgd_control);
+  } else if (sgd_name == "nesterov") {
+    return new async_fit<MODEL, nesterov_sgd>(dataset, model_control,
+      sgd_control);
+  }
+  Rcpp::stop("stochastic gradient method not implemented");
+}
+
+/**
+ * Starts running the proposed model and stochastic gradient method on the
+ * data set on a thread of its own, and returns at once
+ *
+ * @param dataset       data set
+ * @param model_control attributes affiliated with model
+ * @param sgd_control   attributes affiliated with sgd
+ */
+// [[Rcpp::export]]
+SEXP run_async(SEXP dataset, SEXP model_control, SEXP sgd_control) {
+  Rcpp::List Model_control(model_control);
+  std::string model_name = Rcpp::as<std::string>(Model_control["name"]);
+  base_async* fit;
+  if (model_name == "lm" || model_name == "glm") {
+    fit = new_async_fit<glm_model>(Rcpp::List(dataset), Model_control,
+      Rcpp::List(sgd_control));
+  } else if (model_name == "m") {
+    fit = new_async_fit<m_model>(Rcpp::List(dataset), Model_control,
+      Rcpp::List(sgd_control));
+  } else {
+    Rcpp::stop("asynchronous fits not implemented for model yet");
+  }
+  return Rcpp::XPtr<base_async>(fit, true);
+}
+
+// The fit started by run_async(), or an error if it is no longer valid
+base_async& async_handle(SEXP handle) {
+  Rcpp::XPtr<base_async> Handle(handle);
+  if (!Handle.get()) {
+    Rcpp::stop("the fit is no longer valid, e.g., after being saved");
+  }
+  return *Handle;
+}
+
+/**
+ * Reads the progress of a fit started by run_async()
+ *
+ * @param handle external pointer to the fit
+ */
+// [[Rcpp::export]]
+Rcpp::List async_poll(SEXP handle) {
+  return async_handle(handle).poll();
+}
+
+/**
+ * Asks a fit started by run_async() to stop
+ *
+ * @param handle external pointer to the fit
+ */
+// [[Rcpp::export]]
+void async_cancel(SEXP handle) {
+  async_handle(handle).cancel();
+}
+
+/**
+ * Waits for a fit started by run_async() to end, and returns its results
+ *
+ * @param handle external pointer to the fit
+ */
+// [[Rcpp::export]]
+Rcpp::List async_result(SEXP handle) {
+  return async_handle(handle).result();
+}
@@ -6,13 +6,16 @@
 #include "../learn-rate/onedim_learn_rate.h"
 #include "../learn-rate/onedim_eigen_learn_rate.h"
 #include "../learn-rate/ddim_learn_rate.h"
+#include "../parallel/thread_pool.h"
+#include "checkpoint.h"
+#include "state_io.h"
 
 class base_sgd {
   /**
    * Base class for stochastic gradient descent
    *
    * @param sgd       attributes affiliated with sgd as R type
-   * @param n_samples number of data samples
+   * @param n_samples number of data samples, or 0 if not known in advance
    * @param ti        timer for benchmarking how long to get each estimate
    */
 public:
@@ -20,10 +23,25 @@ public:
     name_ = Rcpp::as<std::string>(sgd["method"]);
     n_params_ = Rcpp::as<unsigned>(sgd["nparams"]);
     reltol_ = Rcpp::as<double>(sgd["reltol"]);
+    convergence_every_ = Rcpp::as<unsigned>(sgd["convergence.every"]);
     n_passes_ = Rcpp::as<unsigned>(sgd["npasses"]);
     size_ = Rcpp::as<unsigned>(sgd["size"]);
+    batch_size_ = Rcpp::as<unsigned>(sgd["batch.size"]);
+    n_threads_ = Rcpp::as<unsigned>(sgd["nthreads"]);
+    seed_ = Rcpp::as<unsigned>(sgd["seed"]);
+    std::string checkpoint_file = Rcpp::as<std::string>(sgd["checkpoint"]);
+    if (!checkpoint_file.empty()) {
+      checkpoint_.reset(new checkpoint(checkpoint_file,
+        Rcpp::as<double>(sgd["checkpoint.every"]),
+        Rcpp::as<bool>(sgd["resume"])));
+    }
+    if (batch_size_ > 1) {
+      // Batches are split across the threads; see base_model::batch_gradient.
+      pool_.reset(new thread_pool(n_threads_));
+    }
     estimates_ = zeros<mat>(n_params_, size_);
     last_estimate_ = Rcpp::as<mat>(sgd["start"]);
+    grad_ = zeros<mat>(n_params_, 1);
     t_ = 0;
     n_recorded_ = 0;
     pos_ = Mat<unsigned>(1, size_);
@@ -35,21 +53,29 @@ public:
       truth_ = Rcpp::as<mat>(sgd["truth"]);
     }
 
-    // Set which iterations to store estimates
-    unsigned n_iters = n_samples*n_passes_;
-    for (unsigned i = 0; i < size_; ++i) {
-      pos_(0, i) = int(round(pow(10.,
-                   i * log10(static_cast<double>(n_iters)) / (size_-1))));
-    }
-    if (pos_(0, pos_.n_cols-1) != n_iters) {
-      pos_(0, pos_.n_cols-1) = n_iters;
-    }
-    if (n_iters < size_) {
-      Rcpp::Rcout << "Warning: Too few data points for plotting!" << std::endl;
+    // Set which iterations to store estimates; each takes a batch of
+    // batch_size_ data points.
+    unsigned n_iters = (n_samples*n_passes_ + batch_size_ - 1) / batch_size_;
+    unbounded_ = (n_iters == 0);
+    if (unbounded_) {
+      // Positions are chosen as the estimates arrive; see record_unbounded_.
+      per_decade_ = std::max(1., size_ / 2.);
+    } else {
+      for (unsigned i = 0; i < size_; ++i) {
+        pos_(0, i) = int(round(pow(10.,
+                     i * log10(static_cast<double>(n_iters)) / (size_-1))));
+      }
+      if (pos_(0, pos_.n_cols-1) != n_iters) {
+        pos_(0, pos_.n_cols-1) = n_iters;
+      }
+      if (n_iters < size_) {
+        Rcpp::Rcout << "Warning: Too few data points for plotting!" << std::endl;
+      }
     }
 
     // Set learning rate
     std:: string lr = Rcpp::as<std::string>(sgd["lr"]);
+    lr_needs_gradient_ = (lr != "one-dim");
     vec lr_control = Rcpp::as<vec>(sgd["lr.control"]);
     if (lr == "one-dim") {
       lr_obj_ = new onedim_learn_rate(lr_control(0), lr_control(1),
@@ -75,6 +101,16 @@ public:
   unsigned get_n_passes() const {
     return n_passes_;
   }
+  unsigned batch_size() const {
+    return batch_size_;
+  }
+  unsigned n_threads() const {
+    return n_threads_;
+  }
+  // First data point of the @t th iteration
+  unsigned batch_start(unsigned t) const {
+    return (t - 1) * batch_size_ + 1;
+  }
   mat get_estimates() const {
     return estimates_;
   }
@@ -87,23 +123,38 @@ public:
   bool pass() const {
     return pass_;
   }
+  double reltol() const {
+    return reltol_;
+  }
+  // Number of iterations between checks of convergence
+  unsigned convergence_every() const {
+    return convergence_every_;
+  }
   bool verbose() const {
     return verbose_;
   }
+  // Number of iterations run
+  unsigned iteration() const {
+    return t_;
+  }
+  // Checkpoints of the run, or NULL
+  checkpoint* get_checkpoint() const {
+    return checkpoint_.get();
+  }
 
-  // Check if satisfy convergence threshold.
+  // Check if satisfy convergence threshold. Sums are taken over the
+  // expressions directly, without temporaries.
   bool check_convergence(const mat& theta_new, const mat& theta_old) const {
     // if checking against truth
     double diff;
     if (check_) {
-      diff = mean(mean(pow(theta_new - truth_, 2)));
+      diff = accu(square(theta_new - truth_)) / theta_new.n_elem;
       if (diff < 0.001) {
         return true;
       }
     // if not running fixed number of iterations
     } else if (!pass_) {
-      diff = mean(mean(abs(theta_new - theta_old))) /
-        mean(mean(abs(theta_old)));
+      diff = accu(abs(theta_new - theta_old)) / accu(abs(theta_old));
       if (diff < reltol_) {
         return true;
       }
@@ -115,10 +166,10 @@ public:
     return (*lr_obj_)(t, grad_t);
   }
 
-  //TODO declare update method
+  // Each method writes the estimate after iteration t in place:
   //template<typename MODEL>
-  //mat update(unsigned t, const mat& theta_old, const data_set& data,
-  //MODEL& model, bool& good_gradient);
+  //void update(unsigned t, const mat& theta_old, const data_set& data,
+  //MODEL& model, mat& theta_new, bool& good_gradient);
 
   // base_sgd& operator=(const mat& theta_new) {
   //   last_estimate_ = theta_new;
@@ -139,7 +190,9 @@ public:
   base_sgd& operator=(const mat& theta_new) {
     last_estimate_ = theta_new;
     t_ += 1;
-    if (t_ == pos_[n_recorded_]) {
+    if (unbounded_) {
+      record_unbounded_(theta_new);
+    } else if (t_ == pos_[n_recorded_]) {
       estimates_.col(n_recorded_) = theta_new;
       n_recorded_ += 1;
       while (n_recorded_ < size_ && pos_[n_recorded_-1] == pos_[n_recorded_]) {
@@ -150,24 +203,146 @@ public:
     return *this;
   }
 
+  // Set the estimate after iteration t when iterations are not reported one
+  // at a time, e.g., by parallel workers. Positions up to t that were not
+  // recorded take this estimate.
+  void record(unsigned t, const mat& theta_new) {
+    last_estimate_ = theta_new;
+    t_ = t;
+    while (n_recorded_ < size_ && pos_[n_recorded_] <= t_) {
+      estimates_.col(n_recorded_) = theta_new;
+      n_recorded_ += 1;
+    }
+  }
+
+  // Count an iteration whose estimate the caller updates in place, as with
+  // explicit_sgd::update_in_place(). The estimate is copied only when its
+  // position is recorded or, if keep, as the last estimate; otherwise the
+  // last estimate is left behind until the caller records it.
+  void advance(const mat& theta_new, bool keep) {
+    if (keep) {
+      base_sgd::operator=(theta_new);
+      return;
+    }
+    t_ += 1;
+    if (unbounded_) {
+      record_unbounded_(theta_new);
+    } else {
+      while (n_recorded_ < size_ && pos_[n_recorded_] == t_) {
+        estimates_.col(n_recorded_) = theta_new;
+        n_recorded_ += 1;
+      }
+    }
+  }
+
+  // Set the last estimate, as left behind by advance()
+  void set_last_estimate(const mat& theta_new) {
+    last_estimate_ = theta_new;
+  }
+
+  // Whether check_convergence() reads the estimates, rather than returning
+  // false whatever they are
+  bool checks_estimates() const {
+    return check_ || !pass_;
+  }
+
+  // Write the state of the method to a checkpoint; see checkpoint.h.
+  void save(state_writer& out) const {
+    out.write(static_cast<uint64_t>(seed_));
+    out.write(static_cast<uint64_t>(batch_size_));
+    out.write(static_cast<uint64_t>(t_));
+    out.write(static_cast<uint64_t>(n_recorded_));
+    out.write(per_decade_);
+    out.write(last_estimate_);
+    out.write(estimates_);
+    out.write(pos_);
+    out.write(mat(lr_obj_->state()));
+  }
+
+  // Read the state written by save(), and return whether it was written by a
+  // method with the same attributes.
+  bool load(state_reader& in) {
+    uint64_t seed, batch_size, t, n_recorded;
+    mat lr_state;
+    in.read(seed);
+    in.read(batch_size);
+    in.read(t);
+    in.read(n_recorded);
+    in.read(per_decade_);
+    in.read(last_estimate_);
+    in.read(estimates_);
+    in.read(pos_);
+    in.read(lr_state);
+    t_ = t;
+    n_recorded_ = n_recorded;
+    if (!in.ok() || seed != seed_ || batch_size != batch_size_ ||
+        last_estimate_.n_rows != n_params_ ||
+        estimates_.n_rows != n_params_ || estimates_.n_cols != size_ ||
+        pos_.n_cols != size_ || n_recorded_ > size_ ||
+        !lr_obj_->set_state(vectorise(lr_state))) {
+      return false;
+    }
+    return true;
+  }
+
   void end_early() {
+    // Always keep the last estimate when positions were not set in advance.
+    if (unbounded_ && t_ > 0 && pos_(0, n_recorded_-1) != t_) {
+      estimates_.col(n_recorded_) = last_estimate_;
+      pos_(0, n_recorded_) = t_;
+      n_recorded_ += 1;
+    }
     // Throw away the space for things that were not recorded.
-    pos_.shed_cols(n_recorded_, size_-1);
-    estimates_.shed_cols(n_recorded_, size_-1);
+    if (n_recorded_ < size_) {
+      pos_.shed_cols(n_recorded_, size_-1);
+      estimates_.shed_cols(n_recorded_, size_-1);
+    }
   }
 
 protected:
+  // Record estimates at iterations round(10^(k/per_decade_)), k = 0, 1, ...,
+  // when the number of iterations is not known in advance. Whenever size_
+  // estimates have been stored, every other one is dropped and the grid is
+  // made half as dense, so that at most size_ estimates are kept and they
+  // remain log-uniformly spread over the iterations run so far.
+  void record_unbounded_(const mat& theta_new) {
+    while (t_ == round(pow(10., n_recorded_ / per_decade_))) {
+      estimates_.col(n_recorded_) = theta_new;
+      pos_(0, n_recorded_) = t_;
+      n_recorded_ += 1;
+      if (n_recorded_ == size_) {
+        unsigned n_kept = (n_recorded_ + 1) / 2;
+        for (unsigned i = 1; i < n_kept; ++i) {
+          estimates_.col(i) = estimates_.col(2*i);
+          pos_(0, i) = pos_(0, 2*i);
+        }
+        n_recorded_ = n_kept;
+        per_decade_ /= 2.;
+      }
+    }
+  }
+
   std::string name_;        // name of stochastic gradient method
   unsigned n_params_;       // number of parameters
   double reltol_;           // relative tolerance for convergence
+  unsigned convergence_every_; // iterations between checks of convergence
   unsigned n_passes_;       // number of passes over data
   unsigned size_;           // number of estimates to be recorded (log-uniformly)
+  unsigned batch_size_;     // number of data points per iteration
+  unsigned n_threads_;      // number of threads to run on
+  unsigned seed_;           // seed of the order of the data points
+  std::unique_ptr<checkpoint> checkpoint_; // checkpoints of the run, if any
   mat estimates_;           // collection of stored estimates
   mat last_estimate_;       // last SGD estimate
+  mat grad_;                // gradient of the current iteration
+  std::unique_ptr<thread_pool> pool_; // threads computing batch gradients
   base_learn_rate* lr_obj_; // learning rate
+  bool lr_needs_gradient_;  // whether the learning rate depends on gradients
   unsigned t_;              // current iteration
   unsigned n_recorded_;     // number of coefs that have been recorded
   Mat<unsigned> pos_;       // the iteration of recorded coefficients
+  bool unbounded_;          // whether the number of iterations is unknown
+  double per_decade_;       // estimates recorded per decade of iterations
   bool pass_;               // whether to force running for n_passes_ over data
   bool verbose_;
   bool check_;
@@ -0,0 +1,142 @@
+#ifndef SGD_CHECKPOINT_H
+#define SGD_CHECKPOINT_H
+
+#include "../basedef.h"
+#include "state_io.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+static const char CHECKPOINT_MAGIC[8] = {'S', 'G', 'D', 'C', 'K', 'P', 'T', 0};
+static const uint64_t CHECKPOINT_VERSION = 1;
+
+class checkpoint {
+  /**
+   * Complete state of a run saved to a file, periodically and when the run is
+   * interrupted, from which it can be resumed exactly. The file holds the
+   * estimate, the averaged estimate, and the state of the stochastic gradient
+   * method and its learning rate; the order of the data points follows from
+   * the seed and the iteration, so no state of the data set is needed. Each
+   * checkpoint is written under a temporary name and then renamed, so an
+   * earlier one is never left half overwritten.
+   *
+   * Checkpoints call into R to check for interrupts, so they may only be used
+   * on the main thread.
+   *
+   * @param file   path of the file
+   * @param every  minimum number of seconds between checkpoints
+   * @param resume whether to start from the state in the file
+   */
+public:
+  checkpoint(std::string file, double every, bool resume) :
+    file_(file), every_(every), resume_(resume),
+    last_(std::chrono::steady_clock::now()) {}
+
+  bool resume() const {
+    return resume_;
+  }
+
+  // Check for an interrupt after iteration t, and save the state if one
+  // occurred or a checkpoint is due. Both are checked every 256 iterations.
+  template<typename SGD>
+  void update(unsigned t, const SGD& sgd, const vec& theta,
+    const vec& theta_ave) {
+    if (t % 256 != 0) {
+      return;
+    }
+    try {
+      Rcpp::checkUserInterrupt();
+    } catch (Rcpp::internal::InterruptedException&) {
+      save(sgd, theta, theta_ave);
+      throw;
+    }
+    std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - last_;
+    if (elapsed.count() >= every_) {
+      save(sgd, theta, theta_ave);
+    }
+  }
+
+  template<typename SGD>
+  void save(const SGD& sgd, const vec& theta, const vec& theta_ave) {
+    std::string tmp = file_ + ".tmp";
+    state_writer out(tmp);
+    out.write_bytes(CHECKPOINT_MAGIC, 8);
+    out.write(CHECKPOINT_VERSION);
+    out.write(sgd.name());
+    out.write(theta);
+    out.write(theta_ave);
+    sgd.save(out);
+    bool ok = out.close();
+#ifdef _WIN32
+    ok = ok && (std::remove(file_.c_str()) == 0 || errno == ENOENT);
+#endif
+    if (!ok || std::rename(tmp.c_str(), file_.c_str()) != 0) {
+      std::remove(tmp.c_str());
+      Rcpp::stop("cannot write checkpoint '" + file_ + "'");
+    }
+    last_ = std::chrono::steady_clock::now();
+  }
+
+  // Restore the state saved by save(); sgd must have been constructed with
+  // the same attributes.
+  template<typename SGD>
+  void load(SGD& sgd, vec& theta, vec& theta_ave) {
+    state_reader in(file_);
+    std::string name = read_header(in, file_);
+    in.read(theta);
+    in.read(theta_ave);
+    if (name != sgd.name() || !sgd.load(in) || !in.ok() ||
+        theta.n_rows != sgd.get_last_estimate().n_rows ||
+        theta_ave.n_rows != theta.n_rows) {
+      Rcpp::stop("checkpoint '" + file_ + "' does not match this fit");
+    }
+  }
+
+  // Method, iteration and seed of the state saved to file, which the method
+  // writes first; see base_sgd::save().
+  static void info(std::string file, std::string& name, unsigned& t,
+    unsigned& seed) {
+    state_reader in(file);
+    name = read_header(in, file);
+    vec theta;
+    uint64_t seed_in, batch_size, t_in;
+    in.read(theta);
+    in.read(theta);
+    in.read(seed_in);
+    in.read(batch_size);
+    in.read(t_in);
+    if (!in.ok()) {
+      Rcpp::stop("checkpoint '" + file + "' is truncated");
+    }
+    t = t_in;
+    seed = seed_in;
+  }
+
+private:
+  // Read the magic number, version and method name at the start of a file.
+  static std::string read_header(state_reader& in, const std::string& file) {
+    if (!in.ok()) {
+      Rcpp::stop("cannot open checkpoint '" + file + "'");
+    }
+    char magic[8];
+    uint64_t version;
+    std::string name;
+    in.read_bytes(magic, 8);
+    in.read(version);
+    in.read(name);
+    if (!in.ok() || memcmp(magic, CHECKPOINT_MAGIC, 8) != 0 ||
+        version != CHECKPOINT_VERSION) {
+      Rcpp::stop("'" + file + "' is not an sgd checkpoint");
+    }
+    return name;
+  }
+
+  std::string file_;
+  double every_;
+  bool resume_;
+  std::chrono::steady_clock::time_point last_;  // time of the last checkpoint
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include "../basedef.h"
 #include "../data/data_set.h"
 #include "../learn-rate/learn_rate_value.h"
+#include "../model/base_model.h"
 #include "base_sgd.h"
 
 class explicit_sgd : public base_sgd {
@@ -19,14 +20,146 @@ public:
     base_sgd(sgd, n_samples) {}
 
   template<typename MODEL>
-  mat update(unsigned t, const mat& theta_old, const data_set& data,
-    MODEL& model, bool& good_gradient) {
-    mat grad_t = model.gradient(t, theta_old, data);
-    if (!is_finite(grad_t)) {
+  void update(unsigned t, const mat& theta_old, const data_set& data,
+    MODEL& model, mat& theta_new, bool& good_gradient) {
+    if (batch_size_ > 1) {
+      model.gradient(batch_start(t), batch_size_, theta_old, data, grad_,
+        *pool_);
+    } else {
+      model.gradient(t, theta_old, data, grad_);
+    }
+    if (!is_finite(grad_)) {
       good_gradient = false;
     }
-    learn_rate_value at = learning_rate(t, grad_t);
-    return theta_old + (at * grad_t);
+    const learn_rate_value& at = learning_rate(t, grad_);
+    theta_new = theta_old;
+    at.add_scaled(theta_new, grad_);
+  }
+
+  // Whether iterations may go through update_in_place() instead: each takes
+  // one data point of a sparse design matrix, without averaging, and the
+  // learning rate is a scalar that ignores the gradient.
+  bool sparse_steps(const data_set& data, const base_model& model) const {
+    return data.sparse && batch_size_ == 1 && name_ == "sgd" &&
+      !lr_needs_gradient_ && !model.has_penalty();
+  }
+
+  // Update theta in place by the step of iteration t, touching only the
+  // nonzero covariates of its data point, so that the step takes time in
+  // their number rather than in that of the parameters. Only for models
+  // whose gradient is gradient_scale() times the data point.
+  template<typename MODEL>
+  void update_in_place(unsigned t, const data_set& data, const MODEL& model,
+    mat& theta, bool& good_gradient) {
+    data_point data_pt = data.get_data_point(t);
+    double r = model.gradient_scale(data_pt, theta);
+    if (!std::isfinite(r)) {
+      good_gradient = false;
+      return;
+    }
+    data_pt.add_to(theta, learning_rate(t, grad_).mean() * r);
+  }
+
+  // Run all iterations on n_threads_ threads, which update a shared estimate
+  // without locks (Hogwild). Worker k takes iterations k+1, k+1+n_threads_,
+  // ..., so the workers visit disjoint data points of each pass. Each has its
+  // own learning rate and, if averaging, its own average of the estimates it
+  // produced; the averages are pooled when recorded. Updates touch only the
+  // nonzero covariates of a data point when the learning rate is a scalar
+  // that ignores the gradient and there is no penalty.
+  //
+  // The workers are joined at each position whose estimate is recorded, so
+  // that the estimate is read while no worker writes to it. Workers do not
+  // call into R; a non-finite gradient is reported through good_gradient
+  // once they are done.
+  template<typename MODEL>
+  void run_hogwild(const data_set& data, const MODEL& model,
+    bool& good_gradient) {
+    unsigned n_iters = data.n_samples * n_passes_;
+    bool averaging = (name_ == "asgd");
+    bool sparse_step = !lr_needs_gradient_ && !model.has_penalty();
+    mat theta = last_estimate_;
+    std::vector<mat> aves(n_threads_, theta);
+    std::vector<unsigned> counts(n_threads_, 0);
+    std::vector<std::unique_ptr<base_learn_rate> > lrs;
+    std::vector<mat> grads(n_threads_, zeros<mat>(n_params_, 1));
+    for (unsigned k = 0; k < n_threads_; ++k) {
+      lrs.push_back(std::unique_ptr<base_learn_rate>(lr_obj_->clone()));
+    }
+    std::atomic<bool> good(true);
+
+    // Iterations first to last, inclusive
+    auto worker = [&](unsigned k, unsigned first, unsigned last) {
+      base_learn_rate& lr = *lrs[k];
+      mat& grad_t = grads[k];
+      mat& ave = aves[k];
+      for (unsigned t = first + k; t <= last; t += n_threads_) {
+        data_point data_pt = data.get_data_point(t);
+        double r = model.gradient_scale(data_pt, theta);
+        if (!std::isfinite(r)) {
+          good = false;
+          break;
+        }
+        if (sparse_step) {
+          data_pt.add_to(theta, lr(t, grad_t).mean() * r);
+        } else {
+          grad_t.zeros();
+          if (model.has_penalty()) {
+            model.add_gradient_penalty(grad_t, -1., theta);
+          }
+          data_pt.add_to(grad_t, r);
+          lr(t, grad_t).add_scaled(theta, grad_t);
+        }
+        if (averaging) {
+          // Both lines evaluate in place, without temporaries.
+          counts[k] += 1;
+          ave *= 1. - 1. / counts[k];
+          ave += theta / counts[k];
+        }
+      }
+    };
+    // Pooled average of the workers' averages
+    auto pooled = [&]() {
+      mat pool = zeros<mat>(theta.n_rows, theta.n_cols);
+      unsigned n_total = 0;
+      for (unsigned k = 0; k < n_threads_; ++k) {
+        pool += counts[k] * aves[k];
+        n_total += counts[k];
+      }
+      return mat(pool / std::max(n_total, 1u));
+    };
+
+    // Run up to the next recorded position, rounded up to a whole round of
+    // n_threads_ iterations, so that worker k keeps taking iterations k+1,
+    // k+1+n_threads_, ... across the segments.
+    unsigned first = 1;
+    while (first <= n_iters && good) {
+      unsigned last = n_iters;
+      if (n_recorded_ < size_ && pos_[n_recorded_] < n_iters) {
+        unsigned pos = std::max(static_cast<unsigned>(pos_[n_recorded_]),
+          first);
+        unsigned n_rounds = (pos - first) / n_threads_ + 1;
+        last = std::min(first - 1 + n_rounds * n_threads_, n_iters);
+      }
+      std::vector<std::thread> threads;
+      for (unsigned k = 1; k < n_threads_; ++k) {
+        threads.push_back(std::thread(worker, k, first, last));
+      }
+      worker(0, first, last);
+      for (unsigned k = 0; k < threads.size(); ++k) {
+        threads[k].join();
+      }
+      if (last < n_iters) {
+        record(last, averaging ? pooled() : theta);
+      }
+      first = last + 1;
+    }
+
+    if (averaging) {
+      theta = pooled();
+    }
+    record(n_iters, theta);
+    good_gradient = good;
   }
 
   explicit_sgd& operator=(const mat& theta_new) {
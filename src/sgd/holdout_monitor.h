@@ -0,0 +1,106 @@
+#ifndef SGD_HOLDOUT_MONITOR_H
+#define SGD_HOLDOUT_MONITOR_H
+
+#include "../basedef.h"
+#include "../data/data_set.h"
+#include <thread>
+
+// Mean loss of the model at theta over the data points of a data set
+template<typename MODEL>
+double mean_loss(const data_set& data, const MODEL& model, const mat& theta) {
+  unsigned n = data.n_samples;
+  double loss = 0;
+  for (unsigned t = 1; t <= n; ++t) {
+    loss += model.loss(data.get_data_point(t), theta);
+  }
+  return loss / std::max(n, 1u);
+}
+
+template<typename MODEL>
+class holdout_monitor {
+  /**
+   * Early stopping on the loss of data points held out from training. At
+   * each check the loss at the current estimate is evaluated on a thread of
+   * its own while the iterations go on, and the decision to stop is taken at
+   * the next check, once that evaluation is done; so checks never wait on
+   * the loss, and the decisions do not depend on timing. The iterations stop
+   * once the loss has not improved for a number of checks in a row.
+   *
+   * @param holdout  held-out data points, which must not be read through a
+   *                 stateful reader
+   * @param model    model whose loss to evaluate; its loss must be safe to
+   *                 call concurrently with its gradients
+   * @param reltol   relative decrease of the best loss so far that counts as
+   *                 an improvement
+   * @param patience number of checks in a row without improvement after which
+   *                 to stop
+   */
+public:
+  holdout_monitor(const data_set& holdout, const MODEL& model, double reltol,
+    unsigned patience) :
+    holdout_(holdout), model_(model), reltol_(reltol), patience_(patience),
+    best_(datum::inf), n_worse_(0), pending_t_(0) {}
+
+  ~holdout_monitor() {
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  // Start evaluating the loss at the estimate theta after iteration t, and
+  // return whether to stop given the evaluations finished so far.
+  bool update(unsigned t, const mat& theta) {
+    bool stop = finish();
+    theta_ = theta;
+    pending_t_ = t;
+    thread_ = std::thread([this]() {
+      pending_loss_ = mean_loss(holdout_, model_, theta_);
+    });
+    return stop;
+  }
+
+  // Wait for the pending evaluation, if any, and return whether to stop.
+  bool finish() {
+    if (thread_.joinable()) {
+      thread_.join();
+      record_(pending_t_, pending_loss_);
+    }
+    return n_worse_ >= patience_;
+  }
+
+  // Losses evaluated so far, and the iterations at which they were
+  const std::vector<double>& losses() const {
+    return losses_;
+  }
+  const std::vector<unsigned>& iterations() const {
+    return iterations_;
+  }
+
+private:
+  void record_(unsigned t, double loss) {
+    losses_.push_back(loss);
+    iterations_.push_back(t);
+    if (std::isfinite(loss) &&
+        (best_ == datum::inf || loss < best_ - reltol_ * std::abs(best_))) {
+      best_ = loss;
+      n_worse_ = 0;
+    } else {
+      n_worse_ += 1;
+    }
+  }
+
+  const data_set& holdout_;
+  const MODEL& model_;
+  double reltol_;
+  unsigned patience_;
+  double best_;                     // lowest loss so far
+  unsigned n_worse_;                // checks in a row without improvement
+  std::thread thread_;              // thread evaluating the pending loss
+  mat theta_;                       // estimate whose loss is pending
+  unsigned pending_t_;              // iteration of that estimate
+  double pending_loss_;
+  std::vector<double> losses_;
+  std::vector<unsigned> iterations_;
+};
+
+#endif
@@ -15,20 +15,21 @@ template<typename MODEL>
 class Implicit_fn {
   // Root finding functor for implicit update
   // Evaluates the zeroth, first, and second derivatives of:
-  // ksi - ell(x^T theta + ||x||^2 * ksi)
+  // ksi - at scale_factor(ksi), for the linear predictor eta computed once
+  // per data point
 public:
   typedef boost::math::tuple<double, double, double> tuple_type;
 
-  Implicit_fn(const MODEL& m, double a, const data_point& d, const mat& t,
-    double n) : model_(m), at_(a), data_pt_(d), theta_old_(t), normx_(n) {}
+  Implicit_fn(const MODEL& m, double a, double eta, double y, double n) :
+    model_(m), at_(a), eta_(eta), y_(y), normx_(n) {}
 
   tuple_type operator()(double ksi) const {
     double value = ksi - at_ *
-      model_.scale_factor(ksi, at_, data_pt_, theta_old_, normx_);
+      model_.scale_factor(ksi, eta_, y_, normx_);
     double first = 1 + at_ *
-      model_.scale_factor_first_deriv(ksi, at_, data_pt_, theta_old_, normx_);
+      model_.scale_factor_first_deriv(ksi, eta_, y_, normx_);
     double second = at_ *
-      model_.scale_factor_second_deriv(ksi, at_, data_pt_, theta_old_, normx_);
+      model_.scale_factor_second_deriv(ksi, eta_, y_, normx_);
     tuple_type out(value, first, second);
     return out;
   }
@@ -36,8 +37,8 @@ public:
 private:
   const MODEL& model_;
   double at_;
-  const data_point& data_pt_;
-  const mat& theta_old_;
+  double eta_;
+  double y_;
   double normx_;
 };
 
@@ -52,113 +53,55 @@ public:
   implicit_sgd(Rcpp::List sgd, unsigned n_samples) :
     base_sgd(sgd, n_samples) {
     delta_ = Rcpp::as<double>(sgd["delta"]);
+    penalty_ = zeros<mat>(n_params_, 1);
   }
 
-  mat update(unsigned t, const mat& theta_old, const data_set& data,
-    glm_model& model, bool& good_gradient) {
-    mat theta_new;
-    learn_rate_value at = learning_rate(t, model.gradient(t, theta_old, data));
-    // TODO how to deal with non-scalar learning rates?
-    double at_avg = at.mean();
-
-    data_point data_pt = data.get_data_point(t);
-    double normx = dot(data_pt.x, data_pt.x);
-
-    double r = at_avg * model.scale_factor(0, at_avg, data_pt, theta_old, normx);
-    double lower = 0;
-    double upper = 0;
-    if (r < 0) {
-      lower = r;
-    } else {
-      upper = r;
-    }
-    double ksi;
-    if (lower != upper) {
-      Implicit_fn<glm_model> implicit_fn(model, at_avg, data_pt, theta_old, normx);
-      ksi = boost::math::tools::schroeder_iterate(implicit_fn, (lower +
-        upper)/2, lower, upper, delta_);
+  void update(unsigned t, const mat& theta_old, const data_set& data,
+    glm_model& model, mat& theta_new, bool& good_gradient) {
+    if (batch_size_ > 1) {
+      update_batch_(t, theta_old, data, model, theta_new, good_gradient);
     } else {
-      ksi = lower;
+      update_scalar_(t, theta_old, data, model, theta_new, good_gradient);
     }
-    return theta_old +
-      ksi * data_pt.x.t() -
-      at_avg * model.gradient_penalty(theta_old);
   }
 
-  mat update(unsigned t, const mat& theta_old, const data_set& data,
-    m_model& model, bool& good_gradient) {
-    mat theta_new;
-    learn_rate_value at = learning_rate(t, model.gradient(t, theta_old, data));
-    // TODO how to deal with non-scalar learning rates?
-    double at_avg = at.mean();
-
-    data_point data_pt = data.get_data_point(t);
-    double normx = dot(data_pt.x, data_pt.x);
-
-    double r = at_avg * model.scale_factor(0, at_avg, data_pt, theta_old, normx);
-    double lower = 0;
-    double upper = 0;
-    if (r < 0) {
-      lower = r;
-    } else {
-      upper = r;
-    }
-    double ksi;
-    if (lower != upper) {
-      Implicit_fn<m_model> implicit_fn(model, at_avg, data_pt, theta_old, normx);
-      ksi = boost::math::tools::schroeder_iterate(implicit_fn, (lower +
-        upper)/2, lower, upper, delta_);
+  void update(unsigned t, const mat& theta_old, const data_set& data,
+    m_model& model, mat& theta_new, bool& good_gradient) {
+    if (batch_size_ > 1) {
+      update_batch_(t, theta_old, data, model, theta_new, good_gradient);
     } else {
-      ksi = lower;
+      update_scalar_(t, theta_old, data, model, theta_new, good_gradient);
     }
-    return theta_old +
-      ksi * data_pt.x.t() -
-      at_avg * model.gradient_penalty(theta_old);
   }
 
-  mat update(unsigned t, const mat& theta_old, const data_set& data,
-    cox_model& model, bool& good_gradient) {
+  void update(unsigned t, const mat& theta_old, const data_set& data,
+    cox_model& model, mat& theta_new, bool& good_gradient) {
     data_point data_pt = data.get_data_point(t);
-    unsigned j = data_pt.idx;
-
-    // assuming data points fail in order, i.e., risk set R_i={i,i+1,...,n}
-    vec xi = exp(data.X * theta_old);
-    vec h = zeros<vec>(j);
-    double sum_xi = 0;
-    for (int i = j-1; i < j; --i) {
-      // h_i = d_i/sum(xi[i:n])
-      if (i == j-1) {
-        for (int k = i; k < data.n_samples; ++k) {
-          sum_xi += xi(k);
-        }
-      } else {
-        sum_xi += xi(i);
-      }
-      h(i) = data.Y(i)/sum_xi;
-    }
-    double eta_j = accu(data_pt.x.t() % theta_old); // x_j^T * theta
-    double z = eta_j + data_pt.y - xi[j] * sum(h);
-    double xjnorm = accu(data_pt.x % data_pt.x); // |x_j|^2_2
+    double eta_j = data_pt.dot(theta_old); // x_j^T * theta
+    double z = eta_j + data_pt.y -
+      exp(eta_j) * model.cumulative_hazard(t, data_pt, eta_j, data);
+    double xjnorm = data_pt.sq_norm(); // |x_j|^2_2
 
     //learn_rate_value at = learning_rate(t, model.gradient(t, theta_old, data));
-    learn_rate_value at = learning_rate(t, zeros<mat>(data.n_features));
+    grad_.zeros();
+    const learn_rate_value& at = learning_rate(t, grad_);
     // TODO how to deal with non-scalar learning rates?
     double at_avg = at.mean();
 
-    mat grad_t = (z - (eta_j + at_avg*z*xjnorm)/(1 + at_avg*xjnorm)) *
-      data_pt.x.t();
-    if (!is_finite(grad_t)) {
+    data_pt.add_to(grad_, z - (eta_j + at_avg*z*xjnorm)/(1 + at_avg*xjnorm));
+    if (!is_finite(grad_)) {
       good_gradient = false;
     }
-    return theta_old + (at * grad_t);
+    theta_new = theta_old;
+    at.add_scaled(theta_new, grad_);
   }
 
   template <typename MODEL>
-  mat update(unsigned t, const mat& theta_old, const data_set& data,
-    MODEL& model, bool& good_gradient) {
+  void update(unsigned t, const mat& theta_old, const data_set& data,
+    MODEL& model, mat& theta_new, bool& good_gradient) {
     Rcpp::Rcout << "error: implicit not implemented for model yet" << std::endl;
     good_gradient = false;
-    return theta_old;
+    theta_new = theta_old;
   }
 
   implicit_sgd& operator=(const mat& theta_new) {
@@ -166,7 +109,198 @@ public:
     return *this;
   }
 private:
+  // Implicit update of a model whose loss depends on the estimate through the
+  // linear predictor alone, so that the update reduces to the scalar ksi.
+  template<typename MODEL>
+  void update_scalar_(unsigned t, const mat& theta_old, const data_set& data,
+    MODEL& model, mat& theta_new, bool& good_gradient) {
+    // The data point is fetched once, and its linear predictor shared by the
+    // gradient, if the learning rate needs it, and the implicit solve.
+    data_point data_pt = data.get_data_point(t);
+    double x_theta = data_pt.dot(theta_old);
+    if (lr_needs_gradient_) {
+      grad_.zeros();
+      if (model.has_penalty()) {
+        model.add_gradient_penalty(grad_, -1., theta_old);
+      }
+      data_pt.add_to(grad_, model.gradient_scale(data_pt.y, x_theta));
+    }
+    const learn_rate_value& at = learning_rate(t, grad_);
+
+    // With a diagonal learning rate A, the update is
+    //   theta_new = theta_old - A grad(penalty) + ksi A x,
+    // the root in ksi of the scalar problem with at = 1 and x^T A x for
+    // ||x||^2. Other learning rates are reduced to their mean.
+    bool diagonal = (at.type() == 1);
+    double at_avg = diagonal ? 1. : at.mean();
+    double normx;
+    double eta;
+    theta_new = theta_old;
+    if (diagonal) {
+      normx = data_pt.sq_norm(at.vector());
+      eta = x_theta;
+      if (model.has_penalty()) {
+        penalty_.zeros();
+        model.add_gradient_penalty(penalty_, -1., theta_old);
+        at.add_scaled(theta_new, penalty_);
+        eta = data_pt.dot(theta_new);
+      }
+    } else {
+      normx = data_pt.sq_norm();
+      eta = model.implicit_eta(data_pt, theta_old, x_theta, at_avg);
+      if (model.has_penalty()) {
+        model.add_gradient_penalty(theta_new, -at_avg, theta_old);
+      }
+    }
+
+    double ksi;
+    if (!model.implicit_closed_form(at_avg, eta, data_pt.y, normx, ksi)) {
+      double r = at_avg * model.scale_factor(0, eta, data_pt.y, normx);
+      double lower = 0;
+      double upper = 0;
+      if (r < 0) {
+        lower = r;
+      } else {
+        upper = r;
+      }
+      if (lower != upper) {
+        Implicit_fn<MODEL> implicit_fn(model, at_avg, eta, data_pt.y, normx);
+        ksi = boost::math::tools::schroeder_iterate(implicit_fn, (lower +
+          upper)/2, lower, upper, delta_);
+      } else {
+        ksi = lower;
+      }
+    }
+    if (!std::isfinite(ksi)) {
+      good_gradient = false;
+    }
+    if (diagonal) {
+      data_pt.add_to(theta_new, ksi, at.vector());
+    } else {
+      data_pt.add_to(theta_new, ksi);
+    }
+  }
+
+  // Implicit update over a batch of b data points, of the mean loss:
+  //   theta_new = theta_old - A grad(penalty) + sum_i ksi_i A x_i,
+  //   ksi_i = (1/b) scale_factor_i(x_i^T theta_new),
+  // for the learning rate A, diagonal or reduced to the scalar at.
+  // With eta0 = X^T (theta_old - A grad(penalty)) and G = X^T A X,
+  // x^T theta_new = eta0 + G ksi, so the update is the root of
+  //   F(ksi) = ksi - (1/b) scale_factor(eta0 + G ksi)
+  // in the b multipliers ksi, found by Newton's method from the explicit
+  // step, halving steps that do not decrease |F|. The Jacobian is
+  // I + (1/b) D G, with D the derivatives of the scale factors. For a
+  // scalar at, the multipliers are scaled by at instead, and G is the Gram
+  // matrix of the batch, so that the products need no copy of X.
+  template<typename MODEL>
+  void update_batch_(unsigned t, const mat& theta_old, const data_set& data,
+    MODEL& model, mat& theta_new, bool& good_gradient) {
+    unsigned n = data.get_batch(batch_start(t), batch_size_, Xb_, yb_);
+    eta_ = Xb_.t() * theta_old;
+    if (lr_needs_gradient_) {
+      r_.set_size(n);
+      for (unsigned i = 0; i < n; ++i) {
+        r_(i) = model.gradient_scale(yb_(i), eta_(i));
+      }
+      grad_ = Xb_ * r_ / std::max(n, 1u);
+      if (model.has_penalty()) {
+        model.add_gradient_penalty(grad_, -1., theta_old);
+      }
+    }
+    const learn_rate_value& at = learning_rate(t, grad_);
+    bool diagonal = (at.type() == 1);
+    double at_avg = diagonal ? 1. : at.mean();
+    double c = at_avg / std::max(n, 1u);
+
+    theta_new = theta_old;
+    if (model.has_penalty()) {
+      if (diagonal) {
+        penalty_.zeros();
+        model.add_gradient_penalty(penalty_, -1., theta_old);
+        at.add_scaled(theta_new, penalty_);
+      } else {
+        model.add_gradient_penalty(theta_new, -at_avg, theta_old);
+      }
+      eta_ = Xb_.t() * theta_new;
+    }
+    if (diagonal) {
+      AXb_ = Xb_.each_col() % at.vector();
+      gram_ = Xb_.t() * AXb_;
+    } else {
+      gram_ = Xb_.t() * Xb_;
+    }
+
+    // F and its norm at the multipliers ksi, with the scale factors in r_
+    auto residual = [&](const vec& ksi, vec& F) {
+      eta_ksi_ = eta_ + gram_ * ksi;
+      r_.set_size(n);
+      for (unsigned i = 0; i < n; ++i) {
+        r_(i) = model.scale_factor(0, eta_ksi_(i), yb_(i), 1.);
+      }
+      F = ksi - c * r_;
+      return norm(F);
+    };
+    // Start from the explicit step, of the scale factors at ksi = 0.
+    ksi_ = zeros<vec>(n);
+    residual(ksi_, F_);
+    ksi_ = c * r_;
+    double f = residual(ksi_, F_);
+    double tol = std::ldexp(1., -static_cast<int>(delta_));
+    for (unsigned iter = 0; iter < max_newton && f > 0; ++iter) {
+      // eta_ksi_ holds the linear predictors at ksi_ from its residual.
+      jacobian_ = gram_;
+      for (unsigned i = 0; i < n; ++i) {
+        jacobian_.row(i) *= c * model.scale_factor_first_deriv(0,
+          eta_ksi_(i), yb_(i), 1.);
+      }
+      jacobian_.diag() += 1.;
+      if (!solve(step_, jacobian_, F_)) {
+        break;
+      }
+      double scale = 1.;
+      ksi_new_ = ksi_ - step_;
+      double f_new = residual(ksi_new_, F_new_);
+      for (unsigned k = 0; k < max_halvings && !(f_new < f); ++k) {
+        scale /= 2;
+        ksi_new_ = ksi_ - scale * step_;
+        f_new = residual(ksi_new_, F_new_);
+      }
+      if (!(f_new < f)) {
+        break;
+      }
+      ksi_.swap(ksi_new_);
+      F_.swap(F_new_);
+      f = f_new;
+      if (scale * norm(step_, "inf") <= tol * (1 + norm(ksi_, "inf"))) {
+        break;
+      }
+    }
+    if (!is_finite(ksi_)) {
+      good_gradient = false;
+    }
+    theta_new += (diagonal ? AXb_ : Xb_) * ksi_;
+  }
+
+  static const unsigned max_newton = 50;  // Newton iterations per batch
+  static const unsigned max_halvings = 30; // halvings of a Newton step
+
   double delta_;
+  mat penalty_;  // gradient of the penalty, if the learning rate is diagonal
+  mat Xb_;       // covariates of a batch, one column per data point
+  vec yb_;       // responses of a batch
+  vec eta_;      // linear predictors of the batch before its implicit step
+  vec r_;        // residuals or scale factors of the batch
+  mat AXb_;      // covariates of a batch scaled by a diagonal learning rate
+  mat gram_;     // Gram matrix of the batch, in the metric of the learning
+                 // rate if diagonal
+  mat jacobian_; // Jacobian of the root of the batch update
+  vec eta_ksi_;  // linear predictors of the batch at the last multipliers
+  vec ksi_;      // multipliers of the batch update
+  vec ksi_new_;  // multipliers after a trial step
+  vec step_;     // Newton step
+  vec F_;        // function whose root the multipliers are, at ksi_
+  vec F_new_;    // and at ksi_new_
 };
 
 #endif
@@ -21,21 +21,38 @@ public:
   }
 
   template<typename MODEL>
-  mat update(unsigned t, const mat& theta_old, const data_set& data,
-    MODEL& model, bool& good_gradient) {
-    mat grad_t = model.gradient(t, theta_old, data);
-    if (!is_finite(grad_t)) {
+  void update(unsigned t, const mat& theta_old, const data_set& data,
+    MODEL& model, mat& theta_new, bool& good_gradient) {
+    if (batch_size_ > 1) {
+      model.gradient(batch_start(t), batch_size_, theta_old, data, grad_,
+        *pool_);
+    } else {
+      model.gradient(t, theta_old, data, grad_);
+    }
+    if (!is_finite(grad_)) {
       good_gradient = false;
     }
-    learn_rate_value at = learning_rate(t, grad_t);
-    v_ = mu_ * v_ + (at * grad_t);
-    return theta_old + v_;
+    const learn_rate_value& at = learning_rate(t, grad_);
+    v_ *= mu_;
+    at.add_scaled(v_, grad_);
+    theta_new = theta_old + v_;
   }
 
   momentum_sgd& operator=(const mat& theta_new) {
     base_sgd::operator=(theta_new);
     return *this;
   }
+
+  // The velocity is part of the state of a checkpoint.
+  void save(state_writer& out) const {
+    base_sgd::save(out);
+    out.write(v_);
+  }
+  bool load(state_reader& in) {
+    bool ok = base_sgd::load(in);
+    in.read(v_);
+    return ok && in.ok() && v_.n_rows == n_params_ && v_.n_cols == 1;
+  }
 private:
   double mu_; // factor to weigh previous "velocity"
   mat v_;     // "velocity"
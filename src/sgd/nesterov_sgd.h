@@ -18,27 +18,71 @@ public:
     base_sgd(sgd, n_samples) {
     mu_ = 0.9;
     v_ = last_estimate_;
+    ahead_ = zeros<mat>(n_params_, 1);
+    grad_old_ = zeros<mat>(n_params_, 1);
+    // The gradient at the last estimate only feeds the learning rate, so it
+    // is evaluated only if the learning rate depends on gradients.
+    if (batch_size_ > 1) {
+      unsigned k = lr_needs_gradient_ ? 2 : 1;
+      thetas_ = zeros<mat>(n_params_, k);
+      grads_ = zeros<mat>(n_params_, k);
+    }
   }
 
   template<typename MODEL>
-  mat update(unsigned t, const mat& theta_old, const data_set& data,
-    MODEL& model, bool& good_gradient) {
-    mat grad_t = model.gradient(t, theta_old + mu_*v_, data);
-    if (!is_finite(grad_t)) {
+  void update(unsigned t, const mat& theta_old, const data_set& data,
+    MODEL& model, mat& theta_new, bool& good_gradient) {
+    if (batch_size_ > 1) {
+      // The gradients at all points in one pass over the batch.
+      thetas_.col(0) = theta_old + mu_*v_;
+      if (lr_needs_gradient_) {
+        thetas_.col(1) = theta_old;
+      }
+      model.gradient(batch_start(t), batch_size_, thetas_, data, grads_,
+        *pool_);
+      grad_ = grads_.col(0);
+      if (lr_needs_gradient_) {
+        grad_old_ = grads_.col(1);
+      }
+    } else {
+      ahead_ = theta_old + mu_*v_;
+      model.gradient(t, ahead_, data, grad_);
+      if (lr_needs_gradient_) {
+        model.gradient(t, theta_old, data, grad_old_);
+      }
+    }
+    if (!is_finite(grad_)) {
       good_gradient = false;
     }
-    learn_rate_value at = learning_rate(t, model.gradient(t, theta_old, data));
-    v_ = mu_ * v_ + (at * grad_t);
-    return theta_old + v_;
+    const learn_rate_value& at = learning_rate(t, grad_old_);
+    v_ *= mu_;
+    at.add_scaled(v_, grad_);
+    theta_new = theta_old + v_;
   }
 
   nesterov_sgd& operator=(const mat& theta_new) {
     base_sgd::operator=(theta_new);
     return *this;
   }
+
+  // The velocity is part of the state of a checkpoint.
+  void save(state_writer& out) const {
+    base_sgd::save(out);
+    out.write(v_);
+  }
+  bool load(state_reader& in) {
+    bool ok = base_sgd::load(in);
+    in.read(v_);
+    return ok && in.ok() && v_.n_rows == n_params_ && v_.n_cols == 1;
+  }
 private:
-  double mu_; // factor to weigh previous "velocity"
-  mat v_;     // "velocity"
+  double mu_;     // factor to weigh previous "velocity"
+  mat v_;         // "velocity"
+  mat ahead_;     // point at which the gradient is evaluated
+  mat grad_old_;  // gradient at the last estimate, if the learning rate
+                  // depends on gradients
+  mat thetas_;    // both points, or the one ahead, if batched
+  mat grads_;     // gradients at those points, if batched
 };
 
 #endif
@@ -0,0 +1,115 @@
+#ifndef SGD_STATE_IO_H
+#define SGD_STATE_IO_H
+
+#include "../basedef.h"
+#include <cstdio>
+#include <cstring>
+
+class state_writer {
+  /**
+   * Values written one after another to a binary file, in the byte order of
+   * the machine. Failures are remembered and reported by close().
+   *
+   * @param file path of the file
+   */
+public:
+  state_writer(std::string file) :
+    fp_(fopen(file.c_str(), "wb")), ok_(fp_ != NULL) {}
+
+  ~state_writer() {
+    if (fp_ != NULL) {
+      fclose(fp_);
+    }
+  }
+
+  void write_bytes(const void* p, size_t n) {
+    ok_ = ok_ && fwrite(p, 1, n, fp_) == n;
+  }
+  void write(uint64_t x) {
+    write_bytes(&x, sizeof(x));
+  }
+  void write(double x) {
+    write_bytes(&x, sizeof(x));
+  }
+  void write(const std::string& s) {
+    write(static_cast<uint64_t>(s.size()));
+    write_bytes(s.data(), s.size());
+  }
+  template<typename T>
+  void write(const Mat<T>& m) {
+    write(static_cast<uint64_t>(m.n_rows));
+    write(static_cast<uint64_t>(m.n_cols));
+    write_bytes(m.memptr(), m.n_elem * sizeof(T));
+  }
+
+  // Whether everything was written
+  bool close() {
+    if (fp_ != NULL) {
+      ok_ = (fclose(fp_) == 0) && ok_;
+      fp_ = NULL;
+    }
+    return ok_;
+  }
+
+private:
+  FILE* fp_;
+  bool ok_;
+};
+
+class state_reader {
+  /**
+   * Values read back in the order a state_writer wrote them. Reading past the
+   * end of the file or a malformed value makes ok() false.
+   *
+   * @param file path of the file
+   */
+public:
+  state_reader(std::string file) :
+    fp_(fopen(file.c_str(), "rb")), ok_(fp_ != NULL) {}
+
+  ~state_reader() {
+    if (fp_ != NULL) {
+      fclose(fp_);
+    }
+  }
+
+  bool ok() const {
+    return ok_;
+  }
+
+  void read_bytes(void* p, size_t n) {
+    ok_ = ok_ && fread(p, 1, n, fp_) == n;
+    if (!ok_) {
+      memset(p, 0, n);
+    }
+  }
+  void read(uint64_t& x) {
+    read_bytes(&x, sizeof(x));
+  }
+  void read(double& x) {
+    read_bytes(&x, sizeof(x));
+  }
+  void read(std::string& s) {
+    uint64_t n;
+    read(n);
+    ok_ = ok_ && n < (1u << 16);
+    s.assign(ok_ ? n : 0, ' ');
+    read_bytes(&s[0], s.size());
+  }
+  // Matrices are resized to the dimensions read.
+  template<typename T>
+  void read(Mat<T>& m) {
+    uint64_t n_rows, n_cols;
+    read(n_rows);
+    read(n_cols);
+    ok_ = ok_ && n_rows < (1u << 31) && n_cols < (1u << 31);
+    m.set_size(ok_ ? n_rows : 0, ok_ ? n_cols : 0);
+    read_bytes(m.memptr(), m.n_elem * sizeof(T));
+  }
+
+private:
+  FILE* fp_;
+  bool ok_;
+};
+
+#endif